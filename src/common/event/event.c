@@ -9,215 +9,836 @@
 
 #include "sys/types.h"
 #include "sys/error.h"
+#include "sys/time.h"
 
 #include "event/event.h"
-#include "event/sys.h"
-#include "event/io.h"
+
+#include "trace/trace.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef struct {
+	u8	next;		// Next timer in the same wheel slot (or the free list)
+	u8	slot;		// Wheel slot holding the timer, EVENT_TIMER_NONE when free
+	u8	ch;			// Channel to post the event to
+	u16 rounds; // Full turns of the wheel left before the timer expires
+	u16 period; // Reload value (ms), 0 for a one-shot timer
+	u8	data[EVENT_TIMER_DATA_MAX];
+} event_timer_s;
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static event_channel_s* channel_get(event_ch_e ch);
+static uint	 drain(event_ch_e ch, u8 max, u32 start, u16 budget_us);
+static void	 dispatch(const event_ch_def_s* def, void* event);
+static void* reserve(event_ch_e ch, event_channel_s* channel, u8 size);
+static bool	 space(event_channel_s* channel, u8 size, u8 count);
+static void* oldest(event_channel_s* channel, u8 head, u8* len);
+static bool	 overflow(event_ch_e ch, event_channel_s* channel, u8 size);
+static void	 lost(event_ch_e ch, event_channel_s* channel, u8 action);
+static bool	 merge(event_channel_s* channel, const void* event, u8 size);
+static void	 stat_inc(u16* stat);
+static int	 timer_add(event_ch_e ch, void* event, u16 delay_ms, u16 period_ms,
+											 u8* id);
+static void	 timer_insert(u8 id, u16 delay_ms);
+static void	 timer_free(u8 id);
+static void	 timer_update(void);
+static void	 timer_tick(void);
+
+#ifdef EVENT_HIST_ENABLE
+static void hist_add(u16* hist, u16 time_us);
+#endif
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-// Data structure for general event handling
-static event_channel_s* channels[EVENT_CHANNEL_NB] = {0};
+// The channel that is served first on the next event_update() pass
+static u8 rr_next = 0;
+
+// Timer pool and wheel, each wheel slot is the head of a list of timers.
+// wheel_time is the time (ms) of the last tick.
+static event_timer_s timers[EVENT_TIMERS_MAX];
+static u8						 wheel[EVENT_TIMER_SLOTS];
+static u8						 wheel_pos		 = 0;
+static u32					 wheel_time		 = 0;
+static u8						 timers_free	 = EVENT_TIMER_NONE;
+static u8						 timers_active = 0;
+
+// Set while the wheel posts expired events, see overflow()
+static bool ticking = false;
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int event_init(void) {
-	// Register the core event channel
-	int ret = event_channel_register(EVENT_CHANNEL_SYS, &sys_event_ch);
-	RETURN_ON_ERR(ret);
+	// Build the timer free list
+	memset(wheel, EVENT_TIMER_NONE, sizeof(wheel));
+	for (u8 i = 0; i < EVENT_TIMERS_MAX; i++) {
+		timers[i].slot = EVENT_TIMER_NONE;
+		timers[i].next = (i + 1 < EVENT_TIMERS_MAX) ? i + 1 : EVENT_TIMER_NONE;
+	}
+	timers_free		= 0;
+	timers_active = 0;
+
+	for (u8 ch = 0; ch < EVENT_CHANNEL_NB; ch++) {
+		event_channel_s* channel = channel_get(ch);
+		if (channel == NULL) {
+			continue;
+		}
+
+		// Validate the channel definition
+		if (!channel->queue || channel->data_size == 0 ||
+				!IS_POW2(channel->queue_size) ||
+				channel->queue_size > EVENT_QUEUE_SIZE_MAX) {
+			return ERR_BAD_PARAM;
+		}
+
+		// Any event must fit in the queue after the wrap padding
+		if (channel->variable &&
+				(channel->data_size >= (channel->queue_size / 2) ||
+				 channel->overflow == EVENT_OVERFLOW_OVERWRITE_LAST)) {
+			return ERR_BAD_PARAM;
+		}
 
-	ret = event_channel_register(EVENT_CHANNEL_IO, &io_event_ch);
-	RETURN_ON_ERR(ret);
+		channel->head = 0;
+		channel->tail = 0;
+		memset(&channel->stats, 0, sizeof(channel->stats));
+	}
 
 	return 0;
 }
 
-int event_update(void) {
+int event_update(u16 budget_us) {
+	const u32 start				 = systime_us();
+	u8				first_skipped = EVENT_CHANNEL_NB;
+
+	// Post any timed events that have expired
+	timer_update();
+
+	for (u8 n = 0; n < EVENT_CHANNEL_NB; n++) {
+		u8							 ch			 = (rr_next + n) % EVENT_CHANNEL_NB;
+		event_channel_s* channel = channel_get(ch);
+
+		// Skip channels that are not used by this platform
+		if (channel == NULL) {
+			continue;
+		}
+
+		bool expired = budget_us && ((systime_us() - start) >= budget_us);
 
-	for (uint i = 0; i < EVENT_CHANNEL_NB; i++) {
-		int ret = event_channel_process(i);
-		RETURN_ON_ERR(ret);
+		if (expired && !channel->guaranteed) {
+			if (first_skipped == EVENT_CHANNEL_NB) {
+				first_skipped = ch;
+			}
+			continue;
+		}
+
+		// Guaranteed channels always get their full quantum
+		drain(ch, channel->quantum, start, channel->guaranteed ? 0 : budget_us);
+	}
+
+	// Resume with the channel that missed out, otherwise rotate for fairness
+	if (first_skipped != EVENT_CHANNEL_NB) {
+		rr_next = first_skipped;
+	} else {
+		rr_next = (u8)((rr_next + 1) % EVENT_CHANNEL_NB);
 	}
 
 	return 0;
 }
 
-int event_channel_register(event_ch_e ch, event_channel_s* def) {
-	assert(def);
+int event_channel_process(event_ch_e ch) {
+	assert(ch < EVENT_CHANNEL_NB);
+
+	// Check if the channel is registered
+	assert(channel_get(ch));
+
+	drain(ch, 0, 0, 0);
+	return 0;
+}
+
+
+int event_post(event_ch_e ch, void* event) {
+	assert(event);
 	assert(ch < EVENT_CHANNEL_NB);
 
-	// Check if the channel is already registered
-	if (channels[ch]) {
-		return ERR_DUPLICATE;
+	return event_post_size(ch, event, channel_get(ch)->data_size);
+}
+
+int event_post_size(event_ch_e ch, void* event, uint size) {
+	assert(event);
+
+	event_channel_s* channel = channel_get(ch);
+	assert(channel);
+
+	if (channel->merge && merge(channel, event, (u8)size)) {
+		stat_inc(&channel->stats.merges);
+		return 0;
 	}
 
-	// Validate the channel definition
-	if (!def->queue || def->queue_size == 0 || def->data_size == 0) {
-		return ERR_BAD_PARAM;
+	void* slot = event_reserve_size(ch, size);
+	if (slot == NULL) {
+		return ERR_NO_MEM;
 	}
 
-	// Register the channel
-	channels[ch] = def;
+	// Add the event to the queue
+	memcpy(slot, event, size);
 
-	return 0;
+	return event_commit(ch);
 }
 
-int event_channel_process(event_ch_e ch) {
-	event_channel_s* channel = channels[ch];
+void* event_reserve(event_ch_e ch) {
+	assert(ch < EVENT_CHANNEL_NB);
 
-	// Check if the channel is registered
+	event_channel_s* channel = channel_get(ch);
 	assert(channel);
 
-	// Process all events in the queue
-	for (uint i = 0; i < channel->head; ++i) {
-		void* event = &channel->queue[i * channel->data_size];
+	return reserve(ch, channel, (u8)channel->data_size);
+}
 
-		// Call the event handlers
-		event_ch_handler_s* handler = channel->handlers;
+void* event_reserve_size(event_ch_e ch, uint size) {
+	assert(ch < EVENT_CHANNEL_NB);
 
-		while (handler) {
-			handler->handler(event);
-			handler = handler->next;
+	event_channel_s* channel = channel_get(ch);
+	assert(channel);
+	assert(size && size <= channel->data_size);
+
+	return reserve(ch, channel, (u8)size);
+}
+
+bool event_space(event_ch_e ch, uint size, uint count) {
+	assert(ch < EVENT_CHANNEL_NB);
+
+	event_channel_s* channel = channel_get(ch);
+	assert(channel);
+	assert(size && size <= channel->data_size);
+	assert(count && count <= channel->queue_size);
+
+	return space(channel, (u8)size, (u8)count);
+}
+
+int event_commit(event_ch_e ch) {
+	assert(ch < EVENT_CHANNEL_NB);
+
+	event_channel_s* channel = channel_get(ch);
+	assert(channel);
+
+	const u8 head	 = channel->head;
+	const u8 count = (u8)(head - channel->tail);
+	u8			 len	 = 1;
+
+	// Variable events start with their length, reserve() handled any padding
+	if (channel->variable) {
+		len += channel->queue[head & (channel->queue_size - 1)];
+	}
+
+	// The newest event was replaced in place, it is already published
+	if (channel->overwrite) {
+#ifdef EVENT_HIST_ENABLE
+		if (channel->stamps) {
+			channel->stamps[(head - 1) & (channel->queue_size - 1)] =
+					(u16)systime_us();
 		}
+#endif
+		MEMORY_BARRIER();
+		channel->overwrite = false;
+		stat_inc(&channel->stats.posts);
+		return 0;
+	}
+
+	if ((uint)(count + len) > channel->queue_size) {
+		return ERR_NO_MEM;
+	}
+
+#ifdef EVENT_HIST_ENABLE
+	if (channel->stamps) {
+		channel->stamps[head & (channel->queue_size - 1)] = (u16)systime_us();
+	}
+#endif
+
+#ifdef TRACE_ENABLE
+	// Flag the event if it belongs to the trace in flight
+	if (ch == TRACE_CHANNEL && trace_enqueue()) {
+		uint index = head & (channel->queue_size - 1);
+		index			 = channel->variable ? index + 1 : index * channel->data_size;
+		channel->queue[index] |= TRACE_FLAG;
+	}
+#endif
+
+	// Publish the event to the consumer
+	MEMORY_BARRIER();
+	channel->head = head + len;
+
+	stat_inc(&channel->stats.posts);
+	if (count + len > channel->stats.high_water) {
+		channel->stats.high_water = count + len;
 	}
 
-	// Reset the queue head
-	channel->head = 0;
 	return 0;
 }
 
-int event_channel_subscribe(event_ch_e ch, event_ch_handler_s* new_handler) {
-	assert(new_handler);
+const event_ch_stats_s* event_channel_stats(event_ch_e ch) {
 	assert(ch < EVENT_CHANNEL_NB);
 
-	event_channel_s* channel = channels[ch];
-	assert(channel);
+	event_channel_s* channel = channel_get(ch);
+	if (channel == NULL) {
+		return NULL;
+	}
+
+	return &channel->stats;
+}
+
+int event_channel_stats_reset(event_ch_e ch) {
+	assert(ch < EVENT_CHANNEL_NB);
 
-	// If the channel is configured for only one subscriber
-	// return an error.
-	if (channel->onehandler) {
-		return ERR_UNSUPPORTED;
+	event_channel_s* channel = channel_get(ch);
+	if (channel == NULL) {
+		return ERR_BAD_PARAM;
 	}
 
-	event_ch_handler_s* curr = channel->handlers;
+	memset(&channel->stats, 0, sizeof(event_ch_stats_s));
+	return 0;
+}
+
+int event_post_delayed(event_ch_e ch, void* event, u16 delay_ms, u8* id) {
+	return timer_add(ch, event, delay_ms, 0, id);
+}
 
-	// If the list is empty, add the handler to the start
-	if (curr == NULL) {
-		channel->handlers				= new_handler;
-		channel->handlers->next = NULL;
-		return 0;
+int event_post_periodic(event_ch_e ch, void* event, u16 period_ms, u8* id) {
+	if (period_ms == 0) {
+		return ERR_BAD_PARAM;
+	}
+
+	return timer_add(ch, event, period_ms, period_ms, id);
+}
+
+int event_timer_cancel(u8 id) {
+	if (id >= EVENT_TIMERS_MAX || timers[id].slot == EVENT_TIMER_NONE) {
+		return ERR_BAD_PARAM;
 	}
 
-	// If the list is not empty then insert the new handler based on its
-	// priority
+	// Unlink the timer from its wheel slot
+	u8* link = &wheel[timers[id].slot];
+	while (*link != id) {
+		link = &timers[*link].next;
+	}
+	*link = timers[id].next;
+
+	timer_free(id);
+	return 0;
+}
 
-	// For priority 0, the handler is added to the end of the list
-	if (new_handler->priority == 0) {
-		while (curr->next) {
-			curr = curr->next;
+int event_post_rt(event_ch_e ch, void* event) {
+	assert(event);
+	assert(ch < EVENT_CHANNEL_NB);
+
+	event_ch_def_s def;
+	flash_read(&def, &gEVENT_CHANNELS[ch], sizeof(def));
+	assert(def.channel);
+
+	// Call the event handlers directly
+	dispatch(&def, event);
+
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Get a channel from the event channel table.
+ *
+ * @param ch Enum of the event channel.
+ * @return event_channel_s* Pointer to the channel, NULL if unused.
+ */
+static event_channel_s* channel_get(event_ch_e ch) {
+	event_channel_s* channel;
+	flash_read(&channel, &gEVENT_CHANNELS[ch].channel, sizeof(channel));
+	return channel;
+}
+
+/**
+ * @brief Process up to max queued events from a channel.
+ * Stops early once budget_us has elapsed since start.
+ *
+ * @param ch Enum of the event channel.
+ * @param max Maximum number of events to process (0 = all queued events).
+ * @param start Time (us) the budget is measured from.
+ * @param budget_us Time budget (us), 0 for no limit.
+ * @return uint Number of events processed.
+ */
+static uint drain(event_ch_e ch, u8 max, u32 start, u16 budget_us) {
+	uint count = 0;
+
+	event_ch_def_s def;
+	flash_read(&def, &gEVENT_CHANNELS[ch], sizeof(def));
+	event_channel_s* channel = def.channel;
+
+	// Snapshot the write index, events posted while processing are handled
+	// on the next pass.
+	const u8 head = channel->head;
+	MEMORY_BARRIER();
+
+	while (channel->tail != head) {
+		u8		len;
+		void* event = oldest(channel, head, &len);
+		if (event == NULL) {
+			break; // Only wrap padding was left
+		}
+
+#ifdef EVENT_HIST_ENABLE
+		if (channel->stamps) {
+			u8	index	 = (u8)(channel->tail & (channel->queue_size - 1));
+			u16 waited = (u16)systime_us() - channel->stamps[index];
+			hist_add(channel->stats.queue_hist, waited);
+		}
+#endif
+
+#ifdef TRACE_ENABLE
+		// The handlers must not see the flag
+		u8* type = event;
+		if (ch == TRACE_CHANNEL && (*type & TRACE_FLAG)) {
+			*type &= (u8)~TRACE_FLAG;
+			trace_mark(TRACE_STAGE_DISPATCH);
+		}
+#endif
+
+		// Call the event handlers
+		channel->busy = true;
+		dispatch(&def, event);
+		channel->busy = false;
+
+		// Release the slot back to the producer
+		MEMORY_BARRIER();
+		channel->tail += len;
+		count++;
+
+		if (max && count >= max) {
+			break;
+		} else if (budget_us && ((systime_us() - start) >= budget_us)) {
+			break;
 		}
-		curr->next = new_handler;
-		return 0;
 	}
 
-	// If the priority of the new handler is higher than the first handler in
-	// the list, then insert it at the start
-	if (curr->priority < new_handler->priority) {
-		new_handler->next = curr;
-		channel->handlers = new_handler;
-		return 0;
+	return count;
+}
+
+static void dispatch(const event_ch_def_s* def, void* event) {
+	event_channel_s* channel = def->channel;
+
+	// All events start with their type
+	const u8 type = *(u8*)event;
+	if (type >= EVENT_CH_TYPES_MAX) {
+		return;
 	}
 
-	// For other priorities the handler is inserted into the correct position
-	while (curr->next) {
-		if (curr->next->priority < new_handler->priority) {
-			new_handler->next = curr->next;
-			curr->next				= new_handler;
-			return 0;
+	// The table is already in priority order
+	for (u8 i = 0; i < def->num_handlers; i++) {
+		event_ch_handler_s handler;
+		flash_read(&handler, &def->handlers[i], sizeof(handler));
+
+		if ((handler.types & EVT_TYPE(type)) == 0) {
+			continue;
 		}
-		curr = curr->next;
+
+#ifdef EVENT_HIST_ENABLE
+		u16 start = (u16)systime_us();
+		handler.handler(event);
+		hist_add(channel->stats.handler_hist, (u16)systime_us() - start);
+#else
+		handler.handler(event);
+#endif
+
+		stat_inc(&channel->stats.handler_calls);
+	}
+}
+
+/**
+ * @brief Reserve space for an event, applying the overflow policy if full.
+ *
+ * @param ch Enum of the event channel.
+ * @param channel Pointer to the channel.
+ * @param size Size of the event.
+ * @return void* Pointer to the reserved slot, NULL if rejected.
+ */
+static void* reserve(event_ch_e ch, event_channel_s* channel, u8 size) {
+	if (!space(channel, size, 1) && !overflow(ch, channel, size)) {
+		return NULL;
 	}
 
-	return ERR_UNSUPPORTED;
+	if (!channel->variable) {
+		u8	 slot	 = channel->overwrite ? channel->head - 1 : channel->head;
+		uint index = (slot & (channel->queue_size - 1)) * channel->data_size;
+		return &channel->queue[index];
+	}
+
+	u8 head	 = channel->head;
+	u8 index = (u8)(head & (channel->queue_size - 1));
+
+	// Events are contiguous, if this one does not fit before the end of the
+	// buffer then publish a padding record (length 0) and start again at 0.
+	if ((uint)(index + 1 + size) > channel->queue_size) {
+		channel->queue[index] = 0;
+		MEMORY_BARRIER();
+		channel->head = (u8)(head + (channel->queue_size - index));
+		index					= 0;
+	}
+
+	channel->queue[index] = size;
+	return &channel->queue[index + 1];
 }
 
-int event_channel_unsubscribe(event_ch_e ch, event_ch_handler_s* h) {
-	assert(h);
-	assert(ch < EVENT_CHANNEL_NB);
+/**
+ * @brief Check if there is space in a channel queue for new events.
+ *
+ * @param channel Pointer to the channel.
+ * @param size Size of each event (variable channels only).
+ * @param count Number of events.
+ * @return true if all of the events fit.
+ */
+static bool space(event_channel_s* channel, u8 size, u8 count) {
+	const u8 head = channel->head;
+	const u8 used = (u8)(head - channel->tail);
+
+	if (!channel->variable) {
+		return (uint)(used + count) <= channel->queue_size;
+	}
 
-	event_channel_s* channel = channels[ch];
-	assert(channel);
+	// The length byte of each event, plus the padding when one would wrap
+	uint need	 = 0;
+	uint index = head & (channel->queue_size - 1);
+	for (uint i = 0; i < count; i++) {
+		if (index + 1 + size > channel->queue_size) {
+			need += channel->queue_size - index;
+			index = 0;
+		}
+		need += 1 + size;
+		index += 1 + size;
+	}
 
-	if (channel->onehandler) {
-		return ERR_UNSUPPORTED;
+	return need <= (uint)(channel->queue_size - used);
+}
+
+/**
+ * @brief Get the oldest event in a channel queue, skipping wrap padding.
+ *
+ * @param channel Pointer to the channel.
+ * @param head Write index to stop at.
+ * @param len Returns the number of index positions used by the event.
+ * @return void* Pointer to the event, NULL if there are no events.
+ */
+static void* oldest(event_channel_s* channel, u8 head, u8* len) {
+	if (channel->tail == head) {
+		return NULL;
 	}
 
-	event_ch_handler_s* curr = channel->handlers;
+	u8 index = (u8)(channel->tail & (channel->queue_size - 1));
 
-	// If there are no more handlers then return
-	if (curr == NULL) {
-		return 0;
+	if (!channel->variable) {
+		*len = 1;
+		return &channel->queue[index * channel->data_size];
 	}
 
-	// If the first handler is the one to remove, then remove it
-	if (curr == h) {
-		channel->handlers = curr->next;
-		return 0;
+	// Padding fills the rest of the buffer, the next event is at the start
+	if (channel->queue[index] == 0) {
+		channel->tail += (u8)(channel->queue_size - index);
+		if (channel->tail == head) {
+			return NULL;
+		}
+		index = 0;
+	}
+
+	*len = 1 + channel->queue[index];
+	return &channel->queue[index + 1];
+}
+
+/**
+ * @brief Apply the overflow policy of a channel with a full queue.
+ *
+ * @param ch Enum of the event channel.
+ * @param channel Pointer to the channel.
+ * @param size Size of the new event.
+ * @return true if there is now space for the new event.
+ */
+static bool overflow(event_ch_e ch, event_channel_s* channel, u8 size) {
+	switch (channel->overflow) {
+		case EVENT_OVERFLOW_DROP_OLDEST: {
+			if (channel->busy) {
+				break;
+			}
+
+			// Release the oldest events as if they had been processed, a
+			// variable event may need more than one to be dropped.
+			u8 len;
+			while (oldest(channel, channel->head, &len)) {
+				channel->tail += len;
+				lost(ch, channel, EVENT_OVERFLOW_DROP_OLDEST);
+				if (space(channel, size, 1)) {
+					return true;
+				}
+			}
+
+			return space(channel, size, 1);
+		}
+
+		case EVENT_OVERFLOW_OVERWRITE_LAST: {
+			// The newest slot is only in use if it is also the oldest
+			if (channel->busy && channel->queue_size == 1) {
+				break;
+			}
+
+			channel->overwrite = true;
+			lost(ch, channel, EVENT_OVERFLOW_OVERWRITE_LAST);
+			return true;
+		}
+
+		case EVENT_OVERFLOW_BLOCK: {
+			// Handlers must not run while the wheel is half way through a tick,
+			// they could cancel or add the timers being posted.
+			if (channel->busy || ticking) {
+				break;
+			}
+
+			// Process the oldest events until there is room, nothing is lost
+			const u32 start = systime_us();
+			do {
+				drain(ch, 1, 0, 0);
+				if (space(channel, size, 1)) {
+					return true;
+				}
+			} while ((systime_us() - start) < channel->block_us);
+			break;
+		}
+
+		default: break;
 	}
 
-	// Otherwise, iterate the list and remove the handler
-	while (curr->next) {
-		if (curr->next == h) {
-			curr->next = curr->next->next;
-			return 0;
+	lost(ch, channel, EVENT_OVERFLOW_REJECT_NEW);
+	return false;
+}
+
+/**
+ * @brief Record an event lost to an overflow.
+ *
+ * @param ch Enum of the event channel.
+ * @param channel Pointer to the channel.
+ * @param action The action taken, see event_overflow_e.
+ */
+static void lost(event_ch_e ch, event_channel_s* channel, u8 action) {
+	stat_inc(&channel->stats.drops);
+	if (channel->on_overflow) {
+		channel->on_overflow(ch, action);
+	}
+}
+
+/**
+ * @brief Replace the newest queued event that a new event supersedes.
+ * The event being dispatched (the oldest, while busy) is never replaced.
+ *
+ * @param channel Pointer to the channel.
+ * @param event Pointer to the new event.
+ * @param size Size of the new event.
+ * @return true if a queued event was replaced.
+ */
+static bool merge(event_channel_s* channel, const void* event, u8 size) {
+	const u8 head	 = channel->head;
+	u8*			 found = NULL;
+	u8			 pos	 = channel->tail;
+	bool		 skip	 = channel->busy; // The oldest event is being dispatched
+
+	while (pos != head) {
+		const u8 index = (u8)(pos & (channel->queue_size - 1));
+		u8*			 queued;
+		u8			 len;
+
+		if (!channel->variable) {
+			queued = &channel->queue[index * channel->data_size];
+			len		 = 1;
+		} else if (channel->queue[index] == 0) {
+			// Wrap padding, the next event is at the start
+			pos += (u8)(channel->queue_size - index);
+			continue;
+		} else {
+			queued = &channel->queue[index + 1];
+			len		 = (u8)(1 + channel->queue[index]);
+		}
+
+		// Only events of the same size can be replaced in place
+		if (skip) {
+			skip = false;
+		} else if ((!channel->variable || len == 1 + size) &&
+							 channel->merge(queued, event)) {
+			found = queued;
 		}
-		curr = curr->next;
+
+		pos += len;
+	}
+
+	if (found == NULL) {
+		return false;
 	}
 
-	return ERR_UNSUPPORTED;
+	memcpy(found, event, size);
+	return true;
 }
 
-int event_post(event_ch_e ch, void* event) {
+static void stat_inc(u16* stat) {
+	if (*stat != UINT16_MAX) {
+		(*stat)++;
+	}
+}
+
+#ifdef EVENT_HIST_ENABLE
+static void hist_add(u16* hist, u16 time_us) {
+	u8 bucket = 0;
+
+	time_us >>= EVENT_HIST_BASE_SHIFT;
+	while (time_us && bucket < (EVENT_HIST_BUCKETS - 1)) {
+		time_us >>= 1;
+		bucket++;
+	}
+
+	stat_inc(&hist[bucket]);
+}
+#endif
+
+/**
+ * @brief Allocate a timer and add it to the wheel.
+ *
+ * @param ch Enum of the event channel.
+ * @param event Pointer to the event (copied).
+ * @param delay_ms Delay before the first post.
+ * @param period_ms Reload value, 0 for a one-shot timer.
+ * @param id Optional pointer to store the timer id.
+ * @return int General error code.
+ */
+static int timer_add(event_ch_e ch, void* event, u16 delay_ms, u16 period_ms,
+										 u8* id) {
 	assert(event);
 	assert(ch < EVENT_CHANNEL_NB);
 
-	event_channel_s* channel = channels[ch];
+	event_channel_s* channel = channel_get(ch);
 	assert(channel);
 
-	// Check there is space in the channel event queue
-	if (channel->head >= (channel->queue_size - 1)) {
+	if (channel->variable || channel->data_size > EVENT_TIMER_DATA_MAX) {
+		return ERR_BAD_PARAM;
+	}
+
+	if (timers_free == EVENT_TIMER_NONE) {
 		return ERR_NO_MEM;
 	}
 
-	// Add the event to the queue
-	uint index = channel->head * channel->data_size;
-	memcpy(&channel->queue[index], event, channel->data_size);
-	channel->head++;
+	// The wheel is not ticked while it is empty, bring it up to date
+	if (timers_active == 0) {
+		wheel_time = systime_ms();
+	}
+
+	u8						 t		 = timers_free;
+	event_timer_s* timer = &timers[t];
+	timers_free					 = timer->next;
+	timers_active++;
+
+	timer->ch			= ch;
+	timer->period = period_ms;
+	memcpy(timer->data, event, channel->data_size);
+	timer_insert(t, delay_ms);
+
+	if (id) {
+		*id = t;
+	}
 
 	return 0;
 }
 
-int event_post_rt(event_ch_e ch, void* event) {
-	assert(event);
-	assert(ch < EVENT_CHANNEL_NB);
+/**
+ * @brief Insert a timer into the wheel slot that expires after delay_ms.
+ *
+ * @param id The timer id.
+ * @param delay_ms Delay in milliseconds (0 is treated as 1).
+ */
+static void timer_insert(u8 id, u16 delay_ms) {
+	event_timer_s* timer = &timers[id];
+
+	if (delay_ms == 0) {
+		delay_ms = 1;
+	}
 
-	event_channel_s* channel = channels[ch];
-	assert(channel);
+	u8 slot				= (wheel_pos + delay_ms) & (EVENT_TIMER_SLOTS - 1);
+	timer->rounds = (u16)((delay_ms - 1) / EVENT_TIMER_SLOTS);
+	timer->slot		= slot;
+	timer->next		= wheel[slot];
+	wheel[slot]		= id;
+}
 
-	// Call the event handlers directly
-	event_ch_handler_s* handler = channel->handlers;
+/**
+ * @brief Return a timer to the free list.
+ *
+ * @param id The timer id.
+ */
+static void timer_free(u8 id) {
+	timers[id].slot = EVENT_TIMER_NONE;
+	timers[id].next = timers_free;
+	timers_free			= id;
+	timers_active--;
+}
 
-	while (handler) {
-		handler->handler(event);
-		handler = handler->next;
+/**
+ * @brief Advance the timer wheel by one tick per elapsed millisecond.
+ */
+static void timer_update(void) {
+	if (timers_active == 0) {
+		return;
 	}
 
-	return 0;
+	// Compare the signed difference, a timestamp that is ever ahead of the
+	// wheel (or wraps) must not spin the wheel through the whole u32 range.
+	const u32 now = systime_ms();
+	ticking				= true;
+	while ((i32)(now - wheel_time) > 0 && timers_active) {
+		wheel_time++;
+		timer_tick();
+	}
+	ticking = false;
 }
 
-/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/**
+ * @brief Advance the timer wheel by one slot and post the expired events.
+ */
+static void timer_tick(void) {
+	wheel_pos = (wheel_pos + 1) & (EVENT_TIMER_SLOTS - 1);
+
+	// Unlink the expired timers first, periodic timers may be re-inserted
+	// into the current slot.
+	u8	expired = EVENT_TIMER_NONE;
+	u8* link		= &wheel[wheel_pos];
+
+	while (*link != EVENT_TIMER_NONE) {
+		u8						 t		 = *link;
+		event_timer_s* timer = &timers[t];
+
+		if (timer->rounds) {
+			timer->rounds--;
+			link = &timer->next;
+			continue;
+		}
+
+		*link				= timer->next;
+		timer->next = expired;
+		expired			= t;
+	}
+
+	while (expired != EVENT_TIMER_NONE) {
+		u8						 t		 = expired;
+		event_timer_s* timer = &timers[t];
+		expired							 = timer->next;
+
+		// A full queue is recorded as a drop in the channel statistics
+		event_post(timer->ch, timer->data);
+
+		if (timer->period) {
+			timer_insert(t, timer->period);
+		} else {
+			timer_free(t);
+		}
+	}
+}
@@ -10,7 +10,9 @@
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-#define IO_EVENT_QUEUE_SIZE 32
+#define IO_EVENT_QUEUE_SIZE		32
+#define IO_EVENT_QUEUE_QUANTUM 8
+STATIC_ASSERT(IS_POW2(IO_EVENT_QUEUE_SIZE), "Queue size must be a power of 2");
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -19,12 +21,19 @@
 
 static io_event_s io_event_queue[IO_EVENT_QUEUE_SIZE];
 
+#ifdef EVENT_HIST_ENABLE
+static u16 io_event_stamps[IO_EVENT_QUEUE_SIZE];
+#endif
+
 event_channel_s io_event_ch = {
 		.queue			= (u8*)io_event_queue,
 		.queue_size = IO_EVENT_QUEUE_SIZE,
 		.data_size	= sizeof(io_event_s),
-		.handlers		= NULL,
-		.onehandler = false,
+		.quantum		= IO_EVENT_QUEUE_QUANTUM,
+		.guaranteed = false,
+#ifdef EVENT_HIST_ENABLE
+		.stamps = io_event_stamps,
+#endif
 };
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -11,44 +11,32 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 #define SYS_EVENT_QUEUE_SIZE 8
+STATIC_ASSERT(IS_POW2(SYS_EVENT_QUEUE_SIZE), "Queue size must be a power of 2");
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static int event_handler(void* event);
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static event_sys_s sys_event_queue[8];
+static event_sys_s sys_event_queue[SYS_EVENT_QUEUE_SIZE];
 
-static event_ch_handler_s sys_event_handler = {
-		.handler	= &event_handler,
-		.next			= NULL,
-		.priority = 0,
-};
+#ifdef EVENT_HIST_ENABLE
+static u16 sys_event_stamps[SYS_EVENT_QUEUE_SIZE];
+#endif
 
 event_channel_s sys_event_ch = {
 		.queue			= (u8*)sys_event_queue,
 		.queue_size = SYS_EVENT_QUEUE_SIZE,
 		.data_size	= sizeof(event_sys_s),
-		.handlers		= &sys_event_handler,
-		.onehandler = true,
+		.quantum		= 0,
+		.guaranteed = false,
+#ifdef EVENT_HIST_ENABLE
+		.stamps = sys_event_stamps,
+#endif
 };
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
-
-static int event_handler(void* event) {
-	assert(event);
-
-	event_sys_s* e = (event_sys_s*)event;
-	switch (e->type) {
-		case EVT_SYS_REQ_CFG_SAVE: return ERR_NOT_IMPLEMENTED;
-
-		default: return ERR_BAD_PARAM;
-	}
-
-	return 0;
-}
@@ -9,30 +9,143 @@
 #include "input/encoder.h"
 #include "event/event.h"
 #include "event/io.h"
+#include "sys/utility.h"
 #include <stdint.h>
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define PERIOD_SLOW		(u16)(ENC_ACCEL_SLOW_MS << 4) // Q4
+#define PERIOD_FAST		(u16)(ENC_ACCEL_FAST_MS << 4) // Q4
+#define SPEED_MAX			(255)
+#define ACCEL_TABLE_LEN (16) // Indexed by the top 4 bits of the speed
+
+STATIC_ASSERT(ENC_ACCEL_SLOW_MS > ENC_ACCEL_FAST_MS, "Invalid accel periods");
+STATIC_ASSERT(ENC_ACCEL_GAIN_MAX <= UINT8_MAX, "Accel gain must fit in a u8");
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static u8	speed(u16 period);
+static u16 gain(u8 mode, u8 spd);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// Gain per 1/16th of the speed range, ENC_ACCEL_TABLE
+static const u8 accel_table[ACCEL_TABLE_LEN] = {
+		1, 1, 2, 2, 3, 4, 5, 6, 8, 10, 12, 14, 17, 21, 26, ENC_ACCEL_GAIN_MAX,
+};
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int encoder_init(encoder_s* enc) {
 	assert(enc);
 	enc->velocity		= 0;
+	enc->accel_mode = ENC_ACCEL_EXP;
 	enc->accel_tick = 0;
 	enc->direction	= 0;
+	enc->last_time	= 0;
+	enc->period			= PERIOD_SLOW;
+	enc->divisor		= 1;
+	enc->remainder	= 0;
 	return 0;
 }
 
-void encoder_update(encoder_s* enc, int new_direction) {
-	if (new_direction == 0) {
+void encoder_update(encoder_s* enc, int steps, u16 now) {
+	assert(enc);
+
+	if (steps == 0) {
 		enc->velocity = 0;
 		return;
 	}
 
-	enc->direction = (i8)new_direction;
-	enc->velocity	 = 5 * new_direction;
+	const i8	dir			= (steps > 0) ? 1 : -1;
+	const u16 count		= (u16)((steps > 0) ? steps : -steps);
+	const u16 elapsed = (u16)(now - enc->last_time);
+	enc->last_time		= now;
+
+	// Restart the speed estimate after a pause or a change of direction,
+	// otherwise filter the period of the new detents into the estimate.
+	if (elapsed >= ENC_ACCEL_TIMEOUT_MS || dir != enc->direction) {
+		enc->period = PERIOD_SLOW;
+	} else {
+		u16 period = (u16)(elapsed << 4) / count;
+		if (period > PERIOD_SLOW) {
+			period = PERIOD_SLOW;
+		}
+
+		i16 delta		= (i16)(period - enc->period) / (1 << ENC_ACCEL_FILTER);
+		enc->period = (u16)(enc->period + delta);
+	}
+
+	// A change of direction must move straight away, drop the remainder
+	if (dir != enc->direction) {
+		enc->remainder = 0;
+	}
+
+	enc->direction = dir;
+
+	i32 velocity = (i32)steps * gain(enc->accel_mode, speed(enc->period));
+
+	if (enc->divisor > 1) {
+		// Output whole positions, keep the rest for the following detents
+		velocity			 = velocity + enc->remainder;
+		enc->remainder = (i16)(velocity % enc->divisor);
+		velocity			 = velocity / enc->divisor;
+	}
+
+	enc->velocity = (i16)CLAMP(velocity, -ENC_MAX_VELOCITY, ENC_MAX_VELOCITY);
+}
+
+void encoder_set_divisor(encoder_s* enc, u8 divisor) {
+	assert(enc);
+	assert(divisor > 0);
+
+	enc->divisor	 = divisor;
+	enc->remainder = 0;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// Map a filtered period (Q4) to a speed, 0 = slow, SPEED_MAX = fast
+static u8 speed(u16 period) {
+	if (period >= PERIOD_SLOW) {
+		return 0;
+	} else if (period <= PERIOD_FAST) {
+		return SPEED_MAX;
+	}
+
+	return (u8)(((u32)(PERIOD_SLOW - period) * SPEED_MAX) /
+							(PERIOD_SLOW - PERIOD_FAST));
+}
+
+// Map a speed to a velocity per detent (in positions) using the selected curve
+static u16 gain(u8 mode, u8 spd) {
+	switch (mode) {
+		case ENC_ACCEL_LINEAR: {
+			u32 scaled = (u32)spd * ENC_POS(ENC_ACCEL_GAIN_MAX - 1);
+			return (u16)(ENC_POS(1) + (scaled / SPEED_MAX));
+		}
+
+		case ENC_ACCEL_EXP: {
+			// 2^(5 * spd / 256), interpolated linearly between powers of two
+			u16 exp	 = (u16)spd * 5;
+			u32 base = 1ul << (exp >> 8);
+			u32 pos	 = ENC_POS(base);
+			u32 g		 = pos + ((pos * (exp & 0xFFu)) >> 8);
+			return (u16)CLAMP(g, ENC_POS(1), ENC_POS(ENC_ACCEL_GAIN_MAX));
+		}
+
+		case ENC_ACCEL_TABLE: {
+			// Interpolate between the entries either side of the speed
+			const uint i		= spd >> 4;
+			const uint next = (i + 1 < ACCEL_TABLE_LEN) ? (i + 1) : i;
+			const u16	 lo		= ENC_POS(accel_table[i]);
+			const u16	 hi		= ENC_POS(accel_table[next]);
+			return (u16)(lo + (((u32)(hi - lo) * (spd & 0x0F)) >> 4));
+		}
+
+		case ENC_ACCEL_NONE:
+		default: return ENC_POS(ENC_ACCEL_GAIN);
+	}
+}
@@ -0,0 +1,146 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "input/gesture.h"
+#include "event/event.h"
+#include "event/io.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void timeouts(gesture_x16_ctx_s* ctx, u16 now);
+static void edges(gesture_x16_ctx_s* ctx, u16 pressed, u16 released, u16 now);
+static void post(const gesture_x16_ctx_s* ctx, u8 idx, gesture_e gesture);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void gesture_x16_init(gesture_x16_ctx_s* ctx, u8 evt_type,
+											const gesture_cfg_s* cfg) {
+	assert(ctx);
+	assert(cfg);
+
+	ctx->cfg			= *cfg;
+	ctx->evt_type = evt_type;
+	ctx->held			= 0;
+	ctx->done			= 0;
+	ctx->waiting	= 0;
+}
+
+void gesture_x16_set_cfg(gesture_x16_ctx_s* ctx, const gesture_cfg_s* cfg) {
+	assert(ctx);
+	assert(cfg);
+
+	ctx->cfg = *cfg;
+}
+
+void gesture_x16_update(gesture_x16_ctx_s* ctx, u16 pressed, u16 released,
+												u16 turned, u16 now) {
+	assert(ctx);
+
+	// Resolve the timeouts first, so that an expired double click window is
+	// reported as a short press before a new press on the same switch is seen.
+	timeouts(ctx, now);
+
+	// Turning the encoder of a held switch resolves the press
+	u16 hold_turn = turned & ctx->held & (u16)~ctx->done;
+	ctx->done |= hold_turn;
+
+	for (u8 i = 0; hold_turn != 0; i++, hold_turn >>= 1) {
+		if (hold_turn & 0x01) {
+			post(ctx, i, GESTURE_HOLD_TURN);
+		}
+	}
+
+	edges(ctx, pressed, released, now);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void timeouts(gesture_x16_ctx_s* ctx, u16 now) {
+	// Held switches that are not resolved wait for a long press, released
+	// switches wait for the end of the double click window.
+	u16 pending = (ctx->held & (u16)~ctx->done) | ctx->waiting;
+
+	for (u8 i = 0; pending != 0; i++, pending >>= 1) {
+		if ((pending & 0x01) == 0) {
+			continue;
+		}
+
+		const u16 mask		= (u16)(1u << i);
+		const u16 elapsed = (u16)(now - ctx->stamp[i]);
+
+		if (ctx->waiting & mask) {
+			if (elapsed >= ctx->cfg.double_ms) {
+				ctx->waiting &= (u16)~mask;
+				post(ctx, i, GESTURE_SHORT_PRESS);
+			}
+		} else if (elapsed >= ctx->cfg.long_ms) {
+			ctx->done |= mask;
+			post(ctx, i, GESTURE_LONG_PRESS);
+		}
+	}
+}
+
+static void edges(gesture_x16_ctx_s* ctx, u16 pressed, u16 released, u16 now) {
+	u16 changed = pressed | released;
+
+	for (u8 i = 0; changed != 0; i++, changed >>= 1) {
+		if ((changed & 0x01) == 0) {
+			continue;
+		}
+
+		const u16 mask = (u16)(1u << i);
+
+		if (pressed & mask) {
+			ctx->held |= mask;
+			ctx->stamp[i] = now;
+			post(ctx, i, GESTURE_PRESS);
+
+			// Still inside the double click window (see timeouts())
+			if (ctx->waiting & mask) {
+				ctx->waiting &= (u16)~mask;
+				ctx->done |= mask;
+				post(ctx, i, GESTURE_DOUBLE_CLICK);
+			}
+			continue;
+		}
+
+		ctx->held &= (u16)~mask;
+		post(ctx, i, GESTURE_RELEASE);
+
+		if ((ctx->done & mask) == 0) {
+			if (ctx->cfg.double_ms == 0) {
+				post(ctx, i, GESTURE_SHORT_PRESS);
+			} else {
+				ctx->waiting |= mask;
+				ctx->stamp[i] = now;
+			}
+		}
+
+		ctx->done &= (u16)~mask;
+	}
+}
+
+static void post(const gesture_x16_ctx_s* ctx, u8 idx, gesture_e gesture) {
+	io_event_s evt = {
+			.type				= ctx->evt_type,
+			.sw.idx			= idx,
+			.sw.gesture = (u8)gesture,
+	};
+
+	// Holds are latched on press and cleared on release, so those are handled
+	// immediately. The io channel is not guaranteed, any other dropped gesture
+	// is counted in the channel stats.
+	if (gesture == GESTURE_PRESS || gesture == GESTURE_RELEASE) {
+		event_post_rt(EVENT_CHANNEL_IO, &evt);
+	} else {
+		event_post(EVENT_CHANNEL_IO, &evt);
+	}
+}
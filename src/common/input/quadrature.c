@@ -61,6 +61,45 @@ void quadrature_update(quadrature_s* ctx, uint ch_a, uint ch_b) {
 	uint val = (ch_b << 1) | ch_a;
 	ctx->rot = quad_states[ctx->rot & 0x0F][val];
 	ctx->dir = ctx->rot & 0x30;
+
+	if (ctx->dir == DIR_CW) {
+		ctx->steps++;
+	} else if (ctx->dir == DIR_CCW) {
+		ctx->steps--;
+	}
+}
+
+/*
+ * The state table above has two halves, {START, CW, CCW} and
+ * {MIDDLE, MID_CW, MID_CCW}, and is symmetric between them once the inputs
+ * are inverted in the middle half. With a = ch_a ^ half, b = ch_b ^ half:
+ *
+ *   a = 1, b = 0 : cw pending unless ccw was pending
+ *   a = 0, b = 1 : ccw pending unless cw was pending
+ *   a = 1, b = 1 : back to the start of the half, nothing pending
+ *   a = 0, b = 0 : cross into the other half, a pending detent is emitted
+ *
+ * Which maps directly onto bitwise operations over all 16 encoders.
+ */
+void quadrature_x16_update(quadrature_x16_s* ctx, u16 ch_a, u16 ch_b, u16* cw,
+													 u16* ccw) {
+	assert(ctx);
+	assert(cw);
+	assert(ccw);
+
+	const u16 a			= ch_a ^ ctx->half;
+	const u16 b			= ch_b ^ ctx->half;
+	const u16 cross = (u16) ~(a | b);
+
+	*cw	 = cross & ctx->cw;
+	*ccw = cross & ctx->ccw;
+
+	const u16 pend_cw	 = a & (u16)~b & (u16)~ctx->ccw;
+	const u16 pend_ccw = b & (u16)~a & (u16)~ctx->cw;
+
+	ctx->cw		= pend_cw;
+	ctx->ccw	= pend_ccw;
+	ctx->half = ctx->half ^ cross;
 }
 
 inline int quadrature_direction(quadrature_s* ctx) {
@@ -75,4 +114,16 @@ inline int quadrature_direction(quadrature_s* ctx) {
 	return 0;
 }
 
+int quadrature_steps(quadrature_s* ctx) {
+	assert(ctx);
+
+	// The difference is correct across wrap-around, as long as fewer than
+	// 128 detents are counted between calls.
+	const u8 steps = ctx->steps;
+	const i8 delta = (i8)(u8)(steps - ctx->read);
+	ctx->read			 = steps;
+
+	return delta;
+}
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
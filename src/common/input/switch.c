@@ -35,6 +35,22 @@ u8 switch_x8_states(switch_x8_ctx_s* ctx) {
 	return (ctx->current);
 }
 
+u16 switch_x16_pressed(switch_x16_ctx_s* ctx) {
+	return (ctx->raw & ctx->current);
+}
+
+u16 switch_x16_released(switch_x16_ctx_s* ctx) {
+	return (ctx->raw & (u16)~ctx->current);
+}
+
+u8 switch_x8_pressed(switch_x8_ctx_s* ctx) {
+	return (ctx->raw & ctx->current);
+}
+
+u8 switch_x8_released(switch_x8_ctx_s* ctx) {
+	return (ctx->raw & (u8)~ctx->current);
+}
+
 inline bool switch_was_pressed(switch_x16_ctx_s* ctx, u8 index) {
 	return (ctx->raw & ctx->current) & (1u << index);
 }
@@ -43,54 +59,82 @@ inline bool switch_was_released(switch_x16_ctx_s* ctx, u8 index) {
 	return (ctx->raw & ~ctx->current) & (1u << index);
 }
 
-// Debounce algorithm for 8 switches (call before checking switch state)
-void switch_x8_debounce(switch_x8_ctx_s* ctx) {
-	// Store the current state
-	ctx->previous = ctx->current;
-	ctx->current	= 0xFF;
+void switch_x8_init(switch_x8_ctx_s* ctx, u8 depth) {
+	assert(ctx);
 
-	// AND the new state with EVERY debounce sample, if there was a glitch
-	// then the state of the switch will revert to 0.
-	for (int i = 0; i < SWITCH_DEBOUNCE_SAMPLES; ++i) {
-		ctx->current &= ctx->buf[i];
-	}
+	ctx->cnt[0]	 = 0;
+	ctx->cnt[1]	 = 0;
+	ctx->cnt[2]	 = 0;
+	ctx->current = 0;
+	ctx->raw		 = 0;
+	switch_x8_set_depth(ctx, depth);
+}
+
+void switch_x16_init(switch_x16_ctx_s* ctx, u8 depth) {
+	assert(ctx);
 
-	// Set the raw states to XOR of new and old
-	ctx->raw = ctx->current ^ ctx->previous;
+	ctx->cnt[0]	 = 0;
+	ctx->cnt[1]	 = 0;
+	ctx->cnt[2]	 = 0;
+	ctx->current = 0;
+	ctx->raw		 = 0;
+	switch_x16_set_depth(ctx, depth);
 }
 
-// Debounce algorithm for 16 switches
-void switch_x16_debounce(switch_x16_ctx_s* ctx) {
-	// Store the current state
-	ctx->previous = ctx->current;
-	ctx->current	= 0xFFFF;
+void switch_x8_set_depth(switch_x8_ctx_s* ctx, u8 depth) {
+	assert(ctx);
+	assert(depth > 0 && depth <= SWITCH_DEBOUNCE_DEPTH_MAX);
+
+	ctx->depth = depth;
+}
 
-	// AND the new state with EVERY debounce sample, if there was a glitch
-	// then the state of the switch will revert to 0.
-	for (int i = 0; i < SWITCH_DEBOUNCE_SAMPLES; ++i) {
-		ctx->current &= ctx->buf[i];
-	}
+void switch_x16_set_depth(switch_x16_ctx_s* ctx, u8 depth) {
+	assert(ctx);
+	assert(depth > 0 && depth <= SWITCH_DEBOUNCE_DEPTH_MAX);
 
-	// Set the raw states to XOR of new and old
-	ctx->raw = ctx->current ^ ctx->previous;
+	ctx->depth = depth;
 }
 
 void switch_x8_update(switch_x8_ctx_s* ctx, u8 gpio_state) {
-	// Update the gpio states
-	ctx->buf[ctx->index] = gpio_state;
-
-	// Increment index and wrap if index == SWITCH_DEBOUNCE_SAMPLES
-	ctx->index = (u8)(ctx->index + 1) % SWITCH_DEBOUNCE_SAMPLES;
+	// Switches that differ from their debounced state keep counting, the
+	// counters of all other switches are reset.
+	const u8 delta = gpio_state ^ ctx->current;
+	const u8 c0		 = (u8)~ctx->cnt[0] & delta;
+	const u8 c1		 = (ctx->cnt[1] ^ ctx->cnt[0]) & delta;
+	const u8 c2		 = (ctx->cnt[2] ^ (ctx->cnt[1] & ctx->cnt[0])) & delta;
+
+	// Compare every counter with the depth, matching switches toggle
+	const u8 d0		  = (ctx->depth & 0x01) ? 0xFF : 0x00;
+	const u8 d1		  = (ctx->depth & 0x02) ? 0xFF : 0x00;
+	const u8 d2		  = (ctx->depth & 0x04) ? 0xFF : 0x00;
+	const u8 toggle = delta & (u8)~((c0 ^ d0) | (c1 ^ d1) | (c2 ^ d2));
+
+	ctx->cnt[0]	 = c0 & (u8)~toggle;
+	ctx->cnt[1]	 = c1 & (u8)~toggle;
+	ctx->cnt[2]	 = c2 & (u8)~toggle;
+	ctx->current = ctx->current ^ toggle;
+	ctx->raw		 = toggle;
 }
 
 void switch_x16_update(switch_x16_ctx_s* ctx, u16 gpio_state) {
-	// Update the gpio states
-	ctx->buf[ctx->index] = gpio_state;
-
-	// Increment index and wrap if index == SWITCH_DEBOUNCE_SAMPLES
-	ctx->index = (u8)(ctx->index + 1) % SWITCH_DEBOUNCE_SAMPLES;
-
-	switch_x16_debounce(ctx);
+	// Switches that differ from their debounced state keep counting, the
+	// counters of all other switches are reset.
+	const u16 delta = gpio_state ^ ctx->current;
+	const u16 c0		= (u16)~ctx->cnt[0] & delta;
+	const u16 c1		= (ctx->cnt[1] ^ ctx->cnt[0]) & delta;
+	const u16 c2		= (ctx->cnt[2] ^ (ctx->cnt[1] & ctx->cnt[0])) & delta;
+
+	// Compare every counter with the depth, matching switches toggle
+	const u16 d0		 = (ctx->depth & 0x01) ? 0xFFFF : 0x0000;
+	const u16 d1		 = (ctx->depth & 0x02) ? 0xFFFF : 0x0000;
+	const u16 d2		 = (ctx->depth & 0x04) ? 0xFFFF : 0x0000;
+	const u16 toggle = delta & (u16)~((c0 ^ d0) | (c1 ^ d1) | (c2 ^ d2));
+
+	ctx->cnt[0]	 = c0 & (u16)~toggle;
+	ctx->cnt[1]	 = c1 & (u16)~toggle;
+	ctx->cnt[2]	 = c2 & (u16)~toggle;
+	ctx->current = ctx->current ^ toggle;
+	ctx->raw		 = toggle;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -0,0 +1,129 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include <string.h>
+
+#ifdef __AVR__
+#include <util/atomic.h>
+#endif
+
+#include "sys/time.h"
+#include "trace/trace.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// The trace is started from an interrupt, the main loop must read the 32 bit
+// start time and the expected stage together.
+#ifdef __AVR__
+#define TRACE_ATOMIC ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#else
+#define TRACE_ATOMIC
+#endif
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static trace_stat_s stats[TRACE_STAGE_NB];
+
+static vu32 trace_t0	 = 0;
+static vu8	trace_next = TRACE_STAGE_NB;	 // Next expected stage
+static vu8	trace_id	 = TRACE_INPUT_NONE; // Input that started the trace
+static u8		trace_curr = TRACE_INPUT_NONE; // Input being processed
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void trace_start(u8 id) {
+	u32 now = systime_us();
+
+	// Only one trace in flight, unless it has been abandoned
+	if (trace_next != TRACE_STAGE_NB && (now - trace_t0) < TRACE_TIMEOUT_US) {
+		return;
+	}
+
+	trace_t0	 = now;
+	trace_id	 = id;
+	trace_next = TRACE_STAGE_CREATE;
+	trace_mark(TRACE_STAGE_CREATE);
+}
+
+bool trace_mark(trace_stage_e stage) {
+	const u32 now = systime_us();
+	bool			expected;
+	u32				t0;
+
+	TRACE_ATOMIC {
+		expected = (stage == trace_next);
+		t0			 = trace_t0;
+		if (expected) {
+			trace_next =
+					(u8)((stage + 1 < TRACE_STAGE_NB) ? stage + 1 : TRACE_STAGE_NB);
+		}
+	}
+
+	if (!expected) {
+		return false;
+	}
+
+	u32 elapsed = now - t0;
+	u16 latency = (elapsed > UINT16_MAX) ? UINT16_MAX : (u16)elapsed;
+
+	trace_stat_s* s = &stats[stage];
+	if (s->count == 0 || latency < s->min) {
+		s->min = latency;
+	}
+	if (latency > s->max) {
+		s->max = latency;
+	}
+
+	// Restart the averages rather than overflow
+	if (s->count == UINT16_MAX) {
+		s->sum	 = 0;
+		s->count = 0;
+	}
+
+	s->sum += latency;
+	s->count++;
+
+	return true;
+}
+
+void trace_input(u8 id) {
+	trace_curr = id;
+}
+
+bool trace_enqueue(void) {
+	if (trace_curr == TRACE_INPUT_NONE || trace_curr != trace_id) {
+		return false;
+	}
+
+	return trace_mark(TRACE_STAGE_ENQUEUE);
+}
+
+const trace_stat_s* trace_stats(trace_stage_e stage) {
+	assert(stage < TRACE_STAGE_NB);
+	return &stats[stage];
+}
+
+u16 trace_avg(trace_stage_e stage) {
+	assert(stage < TRACE_STAGE_NB);
+
+	if (stats[stage].count == 0) {
+		return 0;
+	}
+
+	return (u16)(stats[stage].sum / stats[stage].count);
+}
+
+void trace_reset(void) {
+	trace_next = TRACE_STAGE_NB;
+	memset(stats, 0, sizeof(stats));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
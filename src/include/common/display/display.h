@@ -22,6 +22,7 @@
 int display_init(void);
 
 /**
- * @brief Periodic display update.
+ * @brief Redraw any part of the display that has changed.
+ * Called on each EVT_IO_DISPLAY_REFRESH event.
  */
 void display_update(void);
@@ -9,22 +9,62 @@
 #include "sys/types.h"
 #include "sys/utility.h"
 #include "sys/error.h"
+#include "sys/flash.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+// Maximum number of events (or bytes) in a channel queue (u8 indices)
+#define EVENT_QUEUE_SIZE_MAX		(128)
+
+// Number of buckets in the latency histograms (EVENT_HIST_ENABLE)
+#define EVENT_HIST_BUCKETS			(8)
+
+// Bucket 0 holds times below (1 << EVENT_HIST_BASE_SHIFT) microseconds, each
+// following bucket doubles the upper bound, the last bucket holds the rest.
+#define EVENT_HIST_BASE_SHIFT		(6)
+
+// Maximum number of event types per channel (size of the handler type mask)
+#define EVENT_CH_TYPES_MAX			(8)
+
+// Number of timers available to event_post_delayed()/event_post_periodic()
+#define EVENT_TIMERS_MAX				(8)
+
+// Number of slots in the timer wheel (power of two), one slot per millisecond
+#define EVENT_TIMER_SLOTS				(16)
+
+// Maximum event size for timed events, fits the {type, pointer} events
+#define EVENT_TIMER_DATA_MAX		(2 * sizeof(void*))
+
+// Timer id used when no timer is allocated
+#define EVENT_TIMER_NONE				(0xFF)
+
+// Handler type mask for a single event type
+#define EVT_TYPE(t)							((u8)(1u << (t)))
+
+// Handler type mask to receive all event types
+#define EVT_TYPES_ALL						(0xFF)
+
 /**
- * @brief Macro to declare a static event handler.
+ * @brief Macro to define an entry in a channel handler table.
  *
- * @param p Priority (0-255).
- * @param n Name of the structure
+ * @param t Mask of the event types to handle, see EVT_TYPE().
  * @param h Pointer to handler function.
  */
-#define EVT_HANDLER(p, n, h)                                                   \
-	static event_ch_handler_s n = {                                              \
-			.priority = p,                                                           \
-			.handler	= h,                                                           \
-			.next			= NULL,                                                        \
-	}
+#define EVT_HANDLER(t, h)				{.types = (t), .handler = (h)}
+
+/**
+ * @brief Macro to define an entry in the event channel table.
+ *
+ * @param c Pointer to the channel.
+ * @param h Handler table (array of event_ch_handler_s) for the channel.
+ */
+#define EVT_CHANNEL(c, h)                                                      \
+	{ .channel = (c), .handlers = (h), .num_handlers = COUNTOF(h) }
+
+// Macro to define an entry in the event channel table for a channel that
+// has no handlers on this platform.
+#define EVT_CHANNEL_NO_HANDLERS(c)                                             \
+	{ .channel = (c), .handlers = NULL, .num_handlers = 0 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -38,24 +78,81 @@ typedef enum {
 	EVENT_CHANNEL_NB,
 } event_ch_e;
 
+/**
+ * @brief Action taken when an event is posted to a full channel queue.
+ *
+ * EVENT_OVERFLOW_DROP_OLDEST and EVENT_OVERFLOW_BLOCK modify the consumer
+ * side of the queue, so they must only be used for channels where the main
+ * loop is the only producer. If the channel is being processed when the
+ * queue overflows (a handler posting to its own channel) they fall back to
+ * EVENT_OVERFLOW_REJECT_NEW. EVENT_OVERFLOW_BLOCK also falls back for a
+ * delayed or periodic event, no handler runs while the timers are posted.
+ */
+typedef enum {
+	EVENT_OVERFLOW_REJECT_NEW,		 // Discard the new event (default)
+	EVENT_OVERFLOW_DROP_OLDEST,		 // Discard the oldest queued event
+	EVENT_OVERFLOW_OVERWRITE_LAST, // Replace the newest queued event
+	EVENT_OVERFLOW_BLOCK,					 // Process queued events inline to make room
+
+	EVENT_OVERFLOW_NB,
+} event_overflow_e;
+
+/**
+ * @brief Overflow callback, called each time an event is lost.
+ *
+ * @param ch Enum of the event channel.
+ * @param action The action taken, see event_overflow_e.
+ */
+typedef void (*event_overflow_f)(event_ch_e ch, event_overflow_e action);
+
+/**
+ * @brief Merge callback, see event_post_size().
+ *
+ * @param queued Pointer to an event that is still queued.
+ * @param event Pointer to the event being posted, of the same size.
+ * @return true if the new event supersedes the queued event.
+ */
+typedef bool (*event_merge_f)(const void* queued, const void* event);
+
 /**
  * @brief
- * Priority determines the order in which handlers are called.
- * 0 means the handlers are called in the order they were registered.
- * 1 means max priority, and will be called first.
- * 255 means min priority, and will be called last.
+ * Handlers are defined at compile time in a constant table for each channel,
+ * see EVT_HANDLER(). The handlers are called in table order, so the table
+ * must be written in priority order (highest priority first).
  *
- * Most of the time 0 priority is fine.
  * Events that must be handled sychronously (realtime priority) can
  * be posted with the event_post_rt() function - this will block
  * and call each handler in turn immediately.
+ *
+ * The types mask selects which events the handler is called for, bit n
+ * set means events with type n. Every event structure must therefore
+ * start with a u8 type field.
  */
-typedef struct event_ch_handler {
-	u8 priority;
+typedef struct {
+	u8 types;
 	int (*handler)(void* event);
-	struct event_ch_handler* next;
 } event_ch_handler_s;
 
+/**
+ * @brief Event channel statistics.
+ * Counters saturate at their maximum value rather than wrapping.
+ *
+ * The histograms are only maintained when EVENT_HIST_ENABLE is defined,
+ * see EVENT_HIST_BASE_SHIFT for the bucket boundaries.
+ */
+typedef struct {
+	u16 posts;				 // Number of events added to the queue
+	u16 drops;				 // Number of events lost because the queue was full
+	u16 merges;				 // Number of queued events replaced by a newer event
+	u16 handler_calls; // Number of event handler invocations
+	u8	high_water;		 // Maximum queue usage (events, bytes if variable)
+
+#ifdef EVENT_HIST_ENABLE
+	u16 queue_hist[EVENT_HIST_BUCKETS];		// Time spent in the queue
+	u16 handler_hist[EVENT_HIST_BUCKETS]; // Execution time of each handler
+#endif
+} event_ch_stats_s;
+
 /**
  * @brief Event channel structure.
  * The queue parameter is a pointer to a statically allocated buffer.
@@ -63,107 +160,272 @@ typedef struct event_ch_handler {
  * a small buffer is fine. Larger queues increase the latency of
  * events being handled when many events are posted.
  *
- * The handlers parameter is a linked-list of event handlers for this channel.
+ * The queue is a single-producer/single-consumer ring buffer, the size
+ * must be a power of two and no larger than EVENT_QUEUE_SIZE_MAX.
+ * Events may be posted from an ISR without disabling interrupts, as long
+ * as that ISR is the only context posting to the channel. The main loop
+ * is always the consumer.
  *
- * If only one handler is required for all events in the channel then
- * the onehandler parameter can be set to true.
+ * Channels with the variable parameter set store events of different sizes
+ * in a byte ring, each event is prefixed with its length. The queue size is
+ * then in bytes, and data_size is the largest event, which must be less
+ * than half of the queue size. Small events only use their real size, see
+ * event_reserve_size() and event_post_size(). EVENT_OVERFLOW_OVERWRITE_LAST
+ * and delayed events are not supported on variable channels.
+ *
+ * The quantum parameter is the maximum number of events processed from the
+ * channel on each call to event_update(), 0 means all queued events.
+ * Channels with the guaranteed parameter set are always served their
+ * quantum, even when the event_update() time budget has been used up.
  *
  * The size parameter is the size of the queue buffer.
  *
- * The head parameter is the index of the next event to be handled.
- * It is private and should not be modified by the user.
+ * The overflow parameter selects what happens when an event is posted to a
+ * full queue, see event_overflow_e. For EVENT_OVERFLOW_BLOCK the producer
+ * waits at most block_us. The optional on_overflow callback is called each
+ * time an event is lost, in addition to the drops statistic.
+ *
+ * The optional merge callback lets a posted event replace a queued event
+ * that it supersedes (e.g. a newer value for the same control), instead of
+ * taking another slot. Only event_post() and event_post_size() merge, and
+ * like EVENT_OVERFLOW_DROP_OLDEST it must only be used for channels where
+ * the main loop is the only producer.
+ *
+ * The stamps parameter is an optional buffer of queue_size entries used to
+ * measure the time each event spends in the queue (EVENT_HIST_ENABLE only).
+ *
+ * The head and tail parameters are the free-running write and read indices.
+ * They are private and should not be modified by the user, as are the
+ * channel statistics, see event_channel_stats().
  */
 typedef struct {
 	u8*									queue;			// Statically allocated queue buffer
 	const uint					queue_size; // The size of the array (number of messages)
 	const uint					data_size; // Size of data for a single event (for memcpy)
-	event_ch_handler_s* handlers;	 // Link list of handlers
-	bool onehandler; // Set true if handlers is a single handler for all events
-	uint head;			 // (private)
+	bool								variable;		// Events have variable length (see above)
+	u8	 quantum;		 // Max events per event_update() pass (0 = unlimited)
+	bool guaranteed; // Set true to serve the channel even when over budget
+	u8							 overflow;		// Overflow policy, see event_overflow_e
+	u16							 block_us;		// Time limit for EVENT_OVERFLOW_BLOCK
+	event_overflow_f on_overflow; // Optional, called each time an event is lost
+	event_merge_f		 merge;				// Optional, see event_merge_f
+#ifdef EVENT_HIST_ENABLE
+	u16* stamps; // Optional enqueue timestamps, one per queue slot
+#endif
+	vu8							 head;	// (private) Write index, only modified by the producer
+	vu8							 tail;	// (private) Read index, only modified by the consumer
+	event_ch_stats_s stats; // (private) Channel statistics
+
+	// (private) Set while the channel handlers are running, and when the
+	// reserved slot replaces the newest queued event.
+	vu8	 busy;
+	bool overwrite;
 } event_channel_s;
 
+/**
+ * @brief Entry in the event channel table, see gEVENT_CHANNELS.
+ */
+typedef struct {
+	event_channel_s*					channel;		// NULL if unused on this platform
+	const event_ch_handler_s* handlers; // Handler table, in priority order
+	u8												num_handlers;
+} event_ch_def_s;
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief The event channel table, indexed by event_ch_e.
+ * Defined by each platform and stored in flash (read with flash_read()).
+ */
+extern const event_ch_def_s gEVENT_CHANNELS[EVENT_CHANNEL_NB];
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /**
  * @brief Initialise the event-handling system.
+ * Validates and resets every channel in gEVENT_CHANNELS.
  *
  * @return int General error code.
+ * @retval ERR_BAD_PARAM a channel definition is incorrect, or the queue size
+ * is not a power of two.
+ * @retval 0 on success.
  */
 int event_init(void);
 
 /**
- * @brief Processes all queued events in all event channels.
+ * @brief Processes queued events in all event channels.
  * Event handlers for each event are called in priority order.
  *
+ * Channels are served round-robin, each up to its quantum. Once the time
+ * budget is used up the remaining channels are skipped (unless guaranteed),
+ * and the first skipped channel is served first on the next call.
+ *
+ * @param budget_us Time budget in microseconds, 0 for no limit.
  * @return int General error code.
  */
-int event_update(void);
+int event_update(u16 budget_us);
 
 /**
- * @brief Registers a new event channel.
- * @warning The event channel must have an associated enum
- * assigned - see event_ch_e.
+ * @brief Processes all events for a single channel.
+ * Normally there will be no need to do this, but it is available
+ * if required.
  *
- * @param ch The enum for the event channel.
- * @param def Pointer to the channel definition.
+ * @param ch Enum of the event channel.
+ * @return int General error code.
+ */
+int event_channel_process(event_ch_e ch);
+
+/**
+ * @brief Post an event to an event queue.
+ * The event will be handled later when the event_update function
+ * is called as part of the main system loop.
+ *
+ * This function copies the event object into the queue, the
+ * original object can be safely freed (if on the heap).
  *
+ * Safe to call from an ISR, provided the ISR is the only producer
+ * for the channel.
+ *
+ * @param ch Enum of the event channel.
+ * @param event Pointer to the event.
  * @return int General error code.
- * @retval ERR_DUPLICATE if enum value is not unique.
- * @retval ERR_BAD_PARAM if channel definition is incorrect.
+ * @retval ERR_NO_MEM queue is full and the overflow policy rejected the event.
  * @retval 0 on success.
  */
-int event_channel_register(event_ch_e ch, event_channel_s* def);
+int event_post(event_ch_e ch, void* event);
 
 /**
- * @brief Processes all events for a single channel.
- * Normally there will be no need to do this, but it is available
- * if required.
+ * @brief Reserve the next free slot in an event queue.
+ * The producer builds the event directly in the returned slot, and
+ * then publishes it with event_commit(). This avoids building the event
+ * on the stack and copying it into the queue.
+ *
+ * If the queue is full the channel overflow policy is applied, and the
+ * returned slot may replace an event that is already queued.
+ *
+ * Only one slot may be reserved at a time per channel, and the same
+ * single-producer rules as event_post() apply.
+ *
+ * @param ch Enum of the event channel.
+ * @return void* Pointer to the reserved slot, NULL if the queue is full
+ * and the overflow policy rejected the event.
+ */
+void* event_reserve(event_ch_e ch);
+
+/**
+ * @brief Reserve a slot for an event of a given size, see event_reserve().
+ * Only variable channels use less space for smaller events.
  *
  * @param ch Enum of the event channel.
+ * @param size Size of the event, must not exceed the channel data_size.
+ * @return void* Pointer to the reserved slot, NULL if the queue is full
+ * and the overflow policy rejected the event.
+ */
+void* event_reserve_size(event_ch_e ch, uint size);
+
+/**
+ * @brief Post an event of a given size to an event queue, see event_post().
+ * If the channel has a merge callback, the newest queued event that the new
+ * event supersedes is replaced in place and nothing is added.
+ *
+ * @param ch Enum of the event channel.
+ * @param event Pointer to the event.
+ * @param size Size of the event, must not exceed the channel data_size.
  * @return int General error code.
+ * @retval ERR_NO_MEM queue is full and the overflow policy rejected the event.
+ * @retval 0 on success.
  */
-int event_channel_process(event_ch_e ch);
+int event_post_size(event_ch_e ch, void* event, uint size);
 
 /**
- * @brief Subscribe (assign) a new event handler to an existing event channel.
+ * @brief Check if events fit in a channel queue without applying the
+ * overflow policy. A producer that can hold its input back (e.g. leave it in
+ * a hardware buffer) uses this instead of losing events, and a producer of
+ * several related events uses it to post all of them or none.
  *
  * @param ch Enum of the event channel.
- * @param new_handler Pointer to the new event handler.
+ * @param size Size of each event, must not exceed the channel data_size.
+ * @param count Number of events.
+ * @return true if all of the events can be posted.
+ */
+bool event_space(event_ch_e ch, uint size, uint count);
+
+/**
+ * @brief Publish the slot previously reserved with event_reserve().
  *
+ * @param ch Enum of the event channel.
  * @return int General error code.
- * @retval ERR_UNSUPPORTED cannot assign a new handler to this event channel.
+ * @retval ERR_NO_MEM queue is full - no slot was reserved.
  * @retval 0 on success.
  */
-int event_channel_subscribe(event_ch_e ch, event_ch_handler_s* new_handler);
+int event_commit(event_ch_e ch);
 
 /**
- * @brief Unsubscribe an event handler from an existing event channel.
+ * @brief Get the statistics for an event channel.
+ *
+ * @param ch Enum of the event channel.
+ * @return const event_ch_stats_s* Pointer to the statistics, NULL if the
+ * channel is not registered.
+ */
+const event_ch_stats_s* event_channel_stats(event_ch_e ch);
+
+/**
+ * @brief Reset the statistics for an event channel.
  *
  * @param ch Enum of the event channel.
- * @param h Pointer to the existing event handler.
  * @return int General error code.
+ * @retval ERR_BAD_PARAM channel is not registered.
  * @retval 0 on success.
  */
-int event_channel_unsubscribe(event_ch_e ch, event_ch_handler_s* h);
+int event_channel_stats_reset(event_ch_e ch);
 
 /**
- * @brief Post an event to an event queue.
- * The event will be handled later when the event_update function
- * is called as part of the main system loop.
+ * @brief Post an event to an event queue after a delay.
+ * The event is copied, and is posted with event_post() from event_update()
+ * once the delay has expired - the main loop must therefore be the only
+ * producer for the channel.
  *
- * This function copies the event object into the queue, the
- * original object can be safely freed (if on the heap).
+ * Timers are kept in a hashed timer wheel with EVENT_TIMER_SLOTS slots of
+ * 1ms, so the cost of each tick only depends on the timers in one slot.
  *
  * @param ch Enum of the event channel.
  * @param event Pointer to the event.
+ * @param delay_ms Delay in milliseconds.
+ * @param id Optional pointer to store the timer id (for event_timer_cancel).
  * @return int General error code.
- * @retval ERR_NO_MEM queue is full - cannot add a new event.
+ * @retval ERR_BAD_PARAM event is larger than EVENT_TIMER_DATA_MAX, or the
+ * channel is variable.
+ * @retval ERR_NO_MEM no free timers.
  * @retval 0 on success.
  */
-int event_post(event_ch_e ch, void* event);
+int event_post_delayed(event_ch_e ch, void* event, u16 delay_ms, u8* id);
+
+/**
+ * @brief Post an event to an event queue periodically.
+ * The first event is posted after one period, see event_post_delayed().
+ *
+ * @param ch Enum of the event channel.
+ * @param event Pointer to the event.
+ * @param period_ms Period in milliseconds (must not be 0).
+ * @param id Optional pointer to store the timer id (for event_timer_cancel).
+ * @return int General error code.
+ * @retval ERR_BAD_PARAM event is too large, or the period is 0.
+ * @retval ERR_NO_MEM no free timers.
+ * @retval 0 on success.
+ */
+int event_post_periodic(event_ch_e ch, void* event, u16 period_ms, u8* id);
+
+/**
+ * @brief Cancel a delayed or periodic event.
+ *
+ * @param id The timer id.
+ * @return int General error code.
+ * @retval ERR_BAD_PARAM timer is not running (it may have already expired).
+ * @retval 0 on success.
+ */
+int event_timer_cancel(u8 id);
 
 /**
  * @brief Process an event immediately (real-time)
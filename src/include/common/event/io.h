@@ -9,6 +9,7 @@
 #include "sys/types.h"
 #include "input/quadrature.h"
 #include "input/switch.h"
+#include "input/gesture.h"
 #include "event/event.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -20,15 +21,27 @@ extern event_channel_s io_event_ch;
 
 typedef enum {
 	EVT_IO_ENCODER_ROTATION,
-	EVT_IO_ENCODER_SWITCH,
+	EVT_IO_ENCODER_SWITCH, // Encoder switch gesture, see input/gesture.h
 	EVT_IO_BUTTON,
+	EVT_IO_DISPLAY_REFRESH, // Periodic, redraw the display
 
 	EVT_IO_NB,
 } events_io_e;
 
+STATIC_ASSERT(EVT_IO_NB <= EVENT_CH_TYPES_MAX,
+							"Too many event types for the handler type mask");
+
 typedef struct {
-	u8		type;
-	void* ctx;
+	u8 type;
+	union {
+		void* ctx;
+
+		// Switch gestures
+		struct {
+			u8 idx;			// Switch index
+			u8 gesture; // gesture_e
+		} sw;
+	};
 } io_event_s;
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -6,12 +6,24 @@
 #pragma once
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+#include <stddef.h>
+
 #include "sys/types.h"
 #include "event/event.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-#define MIDI_SYSEX_OUT_DATA_LEN_MAX 8
+// Largest sysex reply payload, limited by the MIDI out queue size
+#define MIDI_SYSEX_OUT_DATA_LEN_MAX 56
+
+// Size of a midi event holding the given data type, for event_reserve_size()
+#define MIDI_EVENT_SIZE(type) (offsetof(midi_event_s, data) + sizeof(type))
+#define MIDI_CC_EVENT_SIZE		MIDI_EVENT_SIZE(midi_cc_event_s)
+#define MIDI_NOTE_EVENT_SIZE	MIDI_EVENT_SIZE(midi_note_event_s)
+
+// Size of a sysex out event with len bytes of payload
+#define MIDI_SYSEX_OUT_EVENT_SIZE(len)                                         \
+	(offsetof(midi_event_s, data.sysex_out.data) + (len))
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -23,10 +35,16 @@ extern event_channel_s midi_out_event_ch;
 typedef enum {
 	MIDI_EVENT_CC,
 	MIDI_EVENT_SYSEX,
+	MIDI_EVENT_NOTE_ON,
+	MIDI_EVENT_NOTE_OFF,
+	MIDI_EVENT_CC_VALUE, // Absolute CC value, see midi_event_merge()
 
 	MIDI_EVENT_NB,
 } midi_event_e;
 
+STATIC_ASSERT(MIDI_EVENT_NB <= EVENT_CH_TYPES_MAX,
+							"Too many event types for the handler type mask");
+
 typedef enum {
 	SYSEX_TYPE_1BYTE,
 	SYSEX_TYPE_END_1BYTE = SYSEX_TYPE_1BYTE,
@@ -48,6 +66,12 @@ typedef struct __attribute__((packed)) {
 	u8 value;
 } midi_cc_event_s;
 
+typedef struct __attribute__((packed)) {
+	u8 channel;
+	u8 note;
+	u8 velocity;
+} midi_note_event_s;
+
 typedef struct __attribute__((packed)) {
 	u8 type; // midi_sysex_type_e
 	u8 data[3];
@@ -64,12 +88,25 @@ typedef struct __attribute__((packed)) {
 	u8 type;
 	union {
 		midi_cc_event_s				 cc;
+		midi_note_event_s			 note;
 		midi_sysex_in_event_s	 sysex_in;
 		midi_sysex_out_event_s sysex_out;
 	} data;
 } midi_event_s;
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Merge callback for MIDI out channels, see event_merge_f.
+ * A MIDI_EVENT_CC_VALUE supersedes a queued MIDI_EVENT_CC_VALUE for the same
+ * channel and control, so only the latest value of a control is queued.
+ * Every other event (relative and 14 bit CCs, notes, sysex) is kept.
+ *
+ * @param queued Pointer to the queued midi_event_s.
+ * @param event Pointer to the new midi_event_s.
+ * @return true if the new event replaces the queued event.
+ */
+bool midi_event_merge(const void* queued, const void* event);
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -32,6 +32,9 @@ typedef enum {
 	EVT_SYS_NB,
 } events_core_e;
 
+STATIC_ASSERT(EVT_SYS_NB <= EVENT_CH_TYPES_MAX,
+							"Too many event types for the handler type mask");
+
 typedef struct {
 	u8		type;
 	void* data;
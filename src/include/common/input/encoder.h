@@ -15,16 +15,48 @@
 #define ENC_MIN					 (0)					 // Minimum encoder value
 #define ENC_MID					 (ENC_MAX / 2) // Mid position encoder value
 #define ENC_RANGE				 (u8)(ENC_MAX - ENC_MIN)
-#define ENC_MAX_VELOCITY (1500) // Maximum encoder velocity (absolute)
+
+// Positions are u16 with ENC_POS_FRAC_BITS of sub-LED resolution, the top 8
+// bits are equivalent to an encoder value (ENC_MIN to ENC_MAX).
+#define ENC_POS_FRAC_BITS	(8)
+#define ENC_POS(x)				((u16)((x) << ENC_POS_FRAC_BITS))
+#define ENC_POS_MAX				(u16)(ENC_POS(ENC_MAX) | (ENC_POS(1) - 1))
+#define ENC_MAX_VELOCITY	(ENC_POS_MAX / 2)	// Maximum velocity (absolute)
+
+// Acceleration tuning, periods are in milliseconds per detent
+#define ENC_ACCEL_GAIN			 (5)	 // Values per detent, ENC_ACCEL_NONE
+#define ENC_ACCEL_GAIN_MAX	 (32)	 // Values per detent at full speed
+#define ENC_ACCEL_SLOW_MS		 (80)	 // Period at (or above) which gain is 1
+#define ENC_ACCEL_FAST_MS		 (4)	 // Period at (or below) which gain is max
+#define ENC_ACCEL_TIMEOUT_MS (250) // Idle time that resets the speed estimate
+#define ENC_ACCEL_FILTER		 (2)	 // Period filter coefficient (1 / 2^n)
+
+// Velocity divisor for fine adjustment. At the slowest speed a detent is
+// ENC_POS(1) positions, this makes it 4 positions - one LSB of a 14 bit value
+// spread over the full encoder range.
+#define ENC_FINE_DIV (64)
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+typedef enum {
+	ENC_ACCEL_NONE,		// Fixed velocity per detent
+	ENC_ACCEL_LINEAR, // Gain rises linearly with speed
+	ENC_ACCEL_EXP,		// Gain doubles every 1/5th of the speed range
+	ENC_ACCEL_TABLE,	// Gain from a lookup table
+
+	ENC_ACCEL_NB,
+} encoder_accel_e;
+
 typedef struct {
-	i16 velocity;		// Current rotational velocity
-	u8	accel_mode; // Acceleration mode
+	i16 velocity;		// Current rotational velocity (positions)
+	u8	accel_mode; // Acceleration mode (encoder_accel_e)
 	i8	accel_tick; // Acceleration tick constant
 	i8	direction;	// Current direction
+	u16 last_time;	// Time of the last detent (ms)
+	u16 period;			// Filtered period between detents (ms, Q4)
+	u8	divisor;		// Velocity divisor, 1 = full speed
+	i16 remainder;	// Velocity not yet output because of the divisor
 } encoder_s;
 
 // typedef struct {
@@ -46,15 +78,24 @@ int encoder_init(encoder_s* enc);
 
 /**
  * @brief Perform an update of an encoder.
- * This function takes as input the hardware state of channel A and B
- * of the quadrature encoder, it then processes any change in encoder state
- * and generates an encoder rotation event if required.
+ * The detents are timestamped with the given time, the filtered period
+ * between detents is a measure of rotational speed which is mapped through
+ * the acceleration curve (accel_mode) to a velocity of at most
+ * ENC_MAX_VELOCITY. The result only depends on the inputs, so the same
+ * sequence of steps and times always produces the same velocities.
  *
- * This function should be called at regular intervals to ensure
- * correct processing of acceleration (the algorithm assumes a fixed time
- * constant).
+ * @param enc Pointer to encoder device.
+ * @param steps Net detents since the last update (negative = CCW).
+ * @param now Current time in milliseconds (wraps).
+ */
+void encoder_update(encoder_s* enc, int steps, u16 now);
+
+/**
+ * @brief Set the velocity divisor of an encoder, for fine adjustment.
+ * The part of the velocity lost by the division is accumulated and output
+ * once it adds up to a whole position, so slow movements are not lost.
  *
  * @param enc Pointer to encoder device.
- * @param direction Current direction of encoder (-1, 0, +1)
+ * @param divisor Velocity divisor, 1 for normal operation.
  */
-void encoder_update(encoder_s* enc, int direction);
+void encoder_set_divisor(encoder_s* enc, u8 divisor);
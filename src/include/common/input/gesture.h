@@ -0,0 +1,93 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*
+	Gesture recognition for a set of 16 debounced switches. The recogniser is
+	fed with the pressed/released edge masks from switch_x16_pressed() and
+	switch_x16_released(), plus a mask of the encoders that were turned, and
+	posts an io_event_s for every gesture on EVENT_CHANNEL_IO.
+
+	Every press and release is reported (GESTURE_PRESS/GESTURE_RELEASE). They
+	are posted with event_post_rt() so that they can not be dropped (a lost
+	release would leave a hold latched), which means they are handled before
+	any gesture still in the queue. The update must therefore be called from
+	the main loop. A press is then resolved into at most one of:
+
+		- GESTURE_HOLD_TURN, the encoder was turned while the switch was held.
+		- GESTURE_LONG_PRESS, held for long_ms (reported while still held).
+		- GESTURE_DOUBLE_CLICK, pressed again within double_ms of a release.
+		- GESTURE_SHORT_PRESS, released before long_ms. When double clicks are
+			enabled it is only reported once double_ms has passed without a second
+			press.
+
+	Only switches with a pending edge or timeout are visited, so an update with
+	no activity costs a few mask operations.
+*/
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "sys/types.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef enum {
+	GESTURE_PRESS,
+	GESTURE_RELEASE,
+	GESTURE_SHORT_PRESS,
+	GESTURE_LONG_PRESS,
+	GESTURE_DOUBLE_CLICK,
+	GESTURE_HOLD_TURN,
+
+	GESTURE_NB,
+} gesture_e;
+
+typedef struct {
+	u16 long_ms;	 // Hold time for a long press
+	u16 double_ms; // Maximum gap for a double click, 0 disables double clicks
+} gesture_cfg_s;
+
+typedef struct {
+	gesture_cfg_s	cfg;
+	u8						evt_type;	 // io_event_s type to post (private)
+	u16						held;			 // switches held down (private)
+	u16						done;			 // held switches already resolved (private)
+	u16						waiting;	 // released, waiting for a second press (private)
+	u16						stamp[16]; // time of the last edge in ms (private)
+} gesture_x16_ctx_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Reset a gesture context, all switches start released.
+ *
+ * @param ctx Gesture context.
+ * @param evt_type Type of the io events that are posted (events_io_e).
+ * @param cfg Timing thresholds, copied into the context.
+ */
+void gesture_x16_init(gesture_x16_ctx_s* ctx, u8 evt_type,
+											const gesture_cfg_s* cfg);
+
+/**
+ * @brief Change the timing thresholds, can be called at any time.
+ *
+ * @param ctx Gesture context.
+ * @param cfg Timing thresholds, copied into the context.
+ */
+void gesture_x16_set_cfg(gesture_x16_ctx_s* ctx, const gesture_cfg_s* cfg);
+
+/**
+ * @brief Run the recogniser, call after every switch update.
+ *
+ * @param ctx Gesture context.
+ * @param pressed Switches pressed by the last switch update.
+ * @param released Switches released by the last switch update.
+ * @param turned Encoders that were turned since the last call.
+ * @param now Current time in ms (wraps).
+ */
+void gesture_x16_update(gesture_x16_ctx_s* ctx, u16 pressed, u16 released,
+												u16 turned, u16 now);
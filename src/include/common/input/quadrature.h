@@ -10,16 +10,39 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/**
+ * @brief Quadrature encoder context.
+ * The steps counter is free-running and only written by the decoder (either
+ * quadrature_update() or the owner of a quadrature_x16_s), the consumer keeps
+ * its own copy in read. This allows the encoder to be scanned from an ISR
+ * while the main loop consumes the steps without disabling interrupts (single
+ * byte accesses are atomic).
+ */
 typedef struct {
-	u8 dir; // Current direction
-	u8 rot; // Rotational state
+	u8	dir;	 // Current direction
+	u8	rot;	 // Rotational state
+	vu8 steps; // Net detents (CW - CCW), free-running
+	u8	read;	 // Value of steps at the last quadrature_steps() call
 } quadrature_s;
 
+/**
+ * @brief Bit-sliced decoder context for up to 16 encoders, bit n of each field
+ * holds the state of encoder n. Zero initialise before use.
+ */
+typedef struct {
+	u16 half; // Between detents (private)
+	u16 cw;		// Clockwise detent pending (private)
+	u16 ccw;	// Counter-clockwise detent pending (private)
+} quadrature_x16_s;
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /**
  * @brief Processes the input from a quadrature encoder and returns
  * a direction.
+ * This is the reference for quadrature_x16_update(), the midifighter scan
+ * ISR only uses the bit-sliced decoder. The host build checks the two
+ * against each other.
  *
  * @param ctx Pointer to quadrature context.
  * @param ch_a Current value of channel A.
@@ -27,6 +50,20 @@ typedef struct {
  */
 void quadrature_update(quadrature_s* ctx, uint ch_a, uint ch_b);
 
+/**
+ * @brief Process the inputs of 16 quadrature encoders in one pass.
+ * Equivalent to calling quadrature_update() for each encoder, but the state
+ * table is evaluated with word-wide logic instead of per-encoder lookups.
+ *
+ * @param ctx Pointer to bit-sliced quadrature context.
+ * @param ch_a Current values of channel A, bit n = encoder n.
+ * @param ch_b Current values of channel B, bit n = encoder n.
+ * @param cw Set to the encoders that reached a detent clockwise.
+ * @param ccw Set to the encoders that reached a detent counter-clockwise.
+ */
+void quadrature_x16_update(quadrature_x16_s* ctx, u16 ch_a, u16 ch_b, u16* cw,
+													 u16* ccw);
+
 /**
  * @brief Get the last known direction of a quadrature encoder.
  *
@@ -34,3 +71,12 @@ void quadrature_update(quadrature_s* ctx, uint ch_a, uint ch_b);
  * @return int 0 = stationary, 1 = CW, -1 = CCW.
  */
 int quadrature_direction(quadrature_s* ctx);
+
+/**
+ * @brief Consume the detents counted since the last call.
+ * Must only be called from one context (the consumer).
+ *
+ * @param ctx Pointer to quadrature context.
+ * @return int Net number of detents, positive = CW, negative = CCW.
+ */
+int quadrature_steps(quadrature_s* ctx);
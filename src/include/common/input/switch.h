@@ -12,18 +12,20 @@
 	need to handle < 8 switches then just use the x8. Each unique set of
 	 switches needs its own unique context struct. For general use:
 
-			1. Poll the state of your switches and then add them to a bitfield.
-	 Then call the switch_xN_update() function and pass in the bitfield.
+			1. Call switch_xN_init() once, with the debounce depth.
 
-			2. Call the debounce function once before you attempt to read the
-	 state of the switches.
+			2. Poll the state of your switches and then add them to a bitfield.
+	 Then call the switch_xN_update() function and pass in the bitfield.
 
 			3. Call the switch_xN_state functions to get the state of the
 	 switch(es).
 
-
-	Note - The debounce should not be called every time you poll, that is a
-	 waste of cpu time.
+	Debouncing uses vertical counters - each switch has a 3 bit counter, stored
+	as one bit in each of 3 planes, that counts consecutive samples differing
+	from the debounced state. When the count reaches the depth the switch
+	changes state. All switches are updated with a handful of bitwise
+	operations, the cost does not depend on the depth, and presses and releases
+	are debounced symmetrically.
 */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -31,7 +33,8 @@
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-#define SWITCH_DEBOUNCE_SAMPLES (10)
+#define SWITCH_DEBOUNCE_DEPTH			(4) // Default debounce depth (samples)
+#define SWITCH_DEBOUNCE_DEPTH_MAX (7) // Limit of the 3 bit vertical counters
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -43,19 +46,17 @@ typedef enum {
 } switch_state_e;
 
 typedef struct {
-	u8 buf[SWITCH_DEBOUNCE_SAMPLES]; // debounce buffer (private)
-	u8 index;												 // current buffer index
-	u8 current;											 // states bitfield (private)
-	u8 previous;										 // states bitfield (private)
-	u8 raw;													 // switch states bitfield (private)
+	u8 cnt[3];	// vertical counter planes (private)
+	u8 depth;		// debounce depth in samples (private)
+	u8 current; // debounced states bitfield (private)
+	u8 raw;			// changed states bitfield (private)
 } switch_x8_ctx_s;
 
 typedef struct {
-	u16 buf[SWITCH_DEBOUNCE_SAMPLES]; // debounce buffer (private)
-	u8	index;												// current buffer index
-	u16 current;											// states bitfield (private)
-	u16 previous;											// states bitfield (private)
-	u16 raw;													// switch states bitfield (private)
+	u16 cnt[3];	 // vertical counter planes (private)
+	u8	depth;	 // debounce depth in samples (private)
+	u16 current; // debounced states bitfield (private)
+	u16 raw;		 // changed states bitfield (private)
 } switch_x16_ctx_s;
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -71,13 +72,29 @@ bool switch_was_released(switch_x16_ctx_s*, u8 index);
 u16 switch_x16_states(switch_x16_ctx_s* ctx);
 u8	switch_x8_states(switch_x8_ctx_s* ctx);
 
+// Get the switches pressed/released by the last update as a bitfield
+u16 switch_x16_pressed(switch_x16_ctx_s* ctx);
+u16 switch_x16_released(switch_x16_ctx_s* ctx);
+u8	switch_x8_pressed(switch_x8_ctx_s* ctx);
+u8	switch_x8_released(switch_x8_ctx_s* ctx);
+
+/**
+ * @brief Reset a switch context, all switches start released.
+ *
+ * @param ctx Switch context.
+ * @param depth Debounce depth, 1 to SWITCH_DEBOUNCE_DEPTH_MAX samples.
+ */
+void switch_x8_init(switch_x8_ctx_s* ctx, u8 depth);
+void switch_x16_init(switch_x16_ctx_s* ctx, u8 depth);
+
 /**
- * @brief Run the debounce algorithm for all switches.
+ * @brief Change the debounce depth, can be called at any time.
  *
  * @param ctx Switch context.
+ * @param depth Debounce depth, 1 to SWITCH_DEBOUNCE_DEPTH_MAX samples.
  */
-void switch_x8_debounce(switch_x8_ctx_s* ctx);
-void switch_x16_debounce(switch_x16_ctx_s* ctx);
+void switch_x8_set_depth(switch_x8_ctx_s* ctx, u8 depth);
+void switch_x16_set_depth(switch_x16_ctx_s* ctx, u8 depth);
 
 /**
  * @brief Switch update functions are to be called after you have polled
@@ -91,7 +108,7 @@ void switch_x16_debounce(switch_x16_ctx_s* ctx);
  * (get_state_of_gpio(i) << i);
  * }
  *
- * 3. Call switch update.
+ * 3. Call switch update, this also runs the debounce.
  * switch_x8_update(ctx, state_bitfield);
  *
  * @param ctx Switch context.
@@ -14,6 +14,9 @@
 #include "protocol/midi/midi_sysex_rt.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MIDI_REL_CC_MAX (63) // Largest delta in a single relative CC message
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -21,8 +24,11 @@ typedef enum {
 	MIDI_MODE_DISABLED,
 	MIDI_MODE_CC,
 	MIDI_MODE_CC_14,
-	MIDI_MODE_REL_CC,
-	MIDI_MODE_NOTE,
+	MIDI_MODE_REL_CC, // Relative, two's complement (+1 = 1, -1 = 127)
+	MIDI_MODE_NOTE, // Note, the value is the velocity and cc the note number
+	MIDI_MODE_REL_CC_OFFSET, // Relative, binary offset (+1 = 65, -1 = 63)
+	MIDI_MODE_REL_CC_SIGNED, // Relative, sign-magnitude (+1 = 1, -1 = 65)
+	MIDI_MODE_NOTE_PITCH,		 // Note, the value is the pitch (see MIDI_MODE_NOTE)
 } midi_mode_e;
 
 typedef struct {
@@ -37,9 +43,16 @@ typedef struct {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int midi_init(void);
 int midi_update(void);
 
+/**
+ * @brief Event handler for EVENT_CHANNEL_MIDI_OUT, sends events to the host.
+ *
+ * @param event Pointer to the midi event.
+ * @return int General error code.
+ */
+int midi_out_handler(void* event);
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
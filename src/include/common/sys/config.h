@@ -13,16 +13,22 @@
 
 /* Amount of time (ms) that an encoder will ignore external events
 	after it has recently moved */
-#define DEFAULT_ENC_PLAYDEAD_TIME	 (80)
+#define DEFAULT_ENC_PLAYDEAD_TIME		(80)
 
-#define DEFAULT_MIDI_THROTTLE_TIME (10)
+#define DEFAULT_MIDI_THROTTLE_TIME	(10)
+
+// Switch gesture timing (ms), see input/gesture.h
+#define DEFAULT_GESTURE_LONG_TIME		(500)
+#define DEFAULT_GESTURE_DOUBLE_TIME	(250)
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 typedef struct {
-	u8 enc_dead_time;
-	u8 midi_throttle_time;
+	u8	enc_dead_time;
+	u8	midi_throttle_time;
+	u16 gesture_long_time;
+	u16 gesture_double_time;
 } sys_config_s;
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -25,3 +25,11 @@ void systime_start(void);
  * @return u32 Current time in milliseconds.
  */
 u32 systime_ms(void);
+
+/**
+ * @brief Get the system time with microsecond resolution.
+ * The value wraps roughly every 71 minutes, use unsigned differences.
+ *
+ * @return u32 Current time in microseconds.
+ */
+u32 systime_us(void);
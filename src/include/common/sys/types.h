@@ -32,6 +32,7 @@ typedef enum {
 typedef uint8_t			 u8;
 typedef uint16_t		 u16;
 typedef uint32_t		 u32;
+typedef uint64_t		 u64;
 typedef unsigned int uint;
 
 typedef volatile uint8_t			vu8;
@@ -29,8 +29,26 @@
 // Get the number of elements in an array
 #define COUNTOF(a)						(sizeof(a) / sizeof(*(a)))
 
+// Check if a value is a non-zero power of two
+#define IS_POW2(x)						(((x) != 0) && (((x) & ((x)-1)) == 0))
+
+// Compiler memory barrier, prevents memory accesses being reordered across it
+#define MEMORY_BARRIER()			__asm__ __volatile__("" ::: "memory")
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+	Precomputed scale factor num / den, see scale_init() and scale_apply().
+	The integer part is kept in whole, the fraction is stored as mul / 2^shift
+	with mul normalised to 16 bits. Applying it takes 16x16 -> 32 multiplies
+	and a shift, no division.
+*/
+typedef struct {
+	u16 whole;
+	u16 mul;
+	u8	shift;
+} scale_s;
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -51,3 +69,72 @@ convert_range_i16(i16 c, i16 omin, i16 omax, i16 nmin, i16 nmax) {
 
 	return (((c - omin) * nr) / or) + nmin;
 }
+
+/**
+ * @brief Precompute the scale factor num / den for scale_apply().
+ * The fraction is calculated by long division, with the last bit rounded. A
+ * zero den gives a zero factor.
+ *
+ * @param s Scale factor.
+ * @param num Numerator.
+ * @param den Denominator.
+ */
+__attribute__((__gnu_inline__)) static inline void
+scale_init(scale_s* s, u16 num, u16 den) {
+	s->whole = 0;
+	s->mul	 = 0;
+	s->shift = 0;
+
+	if (den == 0) {
+		return;
+	}
+
+	s->whole = num / den;
+
+	u32 q = 0;
+	u32 r = num % den;
+	if (r == 0) {
+		return;
+	}
+
+	// Add fraction bits until the quotient uses 16 bits
+	while (q < 0x8000 && s->shift < 31) {
+		r <<= 1;
+		q = (q << 1) | (r >= den);
+		r = (r >= den) ? r - den : r;
+		s->shift++;
+	}
+
+	// Round the last bit, renormalise if that overflows
+	if ((r << 1) >= den) {
+		q++;
+		if (q > UINT16_MAX) {
+			q >>= 1;
+			s->shift--;
+		}
+	}
+
+	s->mul = (u16)q;
+}
+
+/**
+ * @brief Scale x by a precomputed factor, rounded to nearest.
+ * The fraction has 16 significant bits, so before rounding the result is
+ * within x * 2^-16 * (num % den) / den of the exact value.
+ *
+ * @param s Scale factor (see scale_init()).
+ * @param x Value to scale.
+ * @return u16 x * num / den, rounded (saturates at UINT16_MAX).
+ */
+__attribute__((__gnu_inline__)) static inline u16
+scale_apply(const scale_s* s, u16 x) {
+	u32 p = (u32)x * s->whole;
+
+	if (s->mul != 0) {
+		// Shift all but the last bit out, then round on it
+		u32 f = (u32)x * s->mul;
+		p += ((f >> (s->shift - 1)) + 1) >> 1;
+	}
+
+	return (p > UINT16_MAX) ? UINT16_MAX : (u16)p;
+}
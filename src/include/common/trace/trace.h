@@ -0,0 +1,128 @@
+#pragma once
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+ * Input-to-output latency tracing (enabled with TRACE_ENABLE).
+ *
+ * One trace is in flight at a time. A trace is started when an input edge is
+ * seen, and each following stage records the time elapsed since the start.
+ * Stages must be marked in order, out of order marks are ignored. A trace
+ * that never completes (e.g. the movement did not produce a MIDI message)
+ * is abandoned after TRACE_TIMEOUT_US.
+ *
+ * The enqueue and dispatch stages are marked by the event system for events
+ * on TRACE_CHANNEL, the platform marks the start and the USB write. The
+ * trace records which input started it, and only an event committed while
+ * that input is being processed (see trace_input()) is traced. The event
+ * carries TRACE_FLAG in its type until it is dispatched, so the later
+ * stages follow that event rather than whichever event happens to be next.
+ */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "sys/types.h"
+#include "event/event.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// The event channel that is traced
+#define TRACE_CHANNEL		 (EVENT_CHANNEL_MIDI_OUT)
+
+// Time after which an incomplete trace is abandoned
+#define TRACE_TIMEOUT_US (100000UL)
+
+// Set in the type of the traced event while it is queued
+#define TRACE_FLAG			 (0x80)
+
+// No input is being processed
+#define TRACE_INPUT_NONE (0xFF)
+
+#ifdef TRACE_ENABLE
+#define TRACE_START(id)	 trace_start(id)
+#define TRACE_MARK(s)		 trace_mark(s)
+#define TRACE_INPUT(id)	 trace_input(id)
+#else
+#define TRACE_START(id)
+#define TRACE_MARK(s)
+#define TRACE_INPUT(id)
+#endif
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef enum {
+	TRACE_STAGE_CREATE,		// Input edge detected, starts the trace
+	TRACE_STAGE_ENQUEUE,	// Event posted to TRACE_CHANNEL
+	TRACE_STAGE_DISPATCH, // Event passed to the channel handlers
+	TRACE_STAGE_USB,			// Packet written to the USB endpoint
+
+	TRACE_STAGE_NB,
+} trace_stage_e;
+
+// Latency (us) from the start of the trace to a stage
+typedef struct {
+	u16 min;
+	u16 max;
+	u32 sum;
+	u16 count;
+} trace_stat_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/**
+ * @brief Start a new trace, ignored if a trace is already in flight.
+ * Safe to call from an interrupt.
+ *
+ * @param id The input that started the trace.
+ */
+void trace_start(u8 id);
+
+/**
+ * @brief Record the latency of a stage for the trace in flight.
+ *
+ * @param stage The stage that has been reached.
+ * @return true if the stage was recorded, false if it was not expected.
+ */
+bool trace_mark(trace_stage_e stage);
+
+/**
+ * @brief Set the input that is being processed, the next event committed to
+ * TRACE_CHANNEL is traced if this input started the trace in flight.
+ *
+ * @param id The input, TRACE_INPUT_NONE when done.
+ */
+void trace_input(u8 id);
+
+/**
+ * @brief Mark the enqueue stage if the current input started the trace.
+ * Called by the event system when an event is committed to TRACE_CHANNEL.
+ *
+ * @return true if the event should be flagged with TRACE_FLAG.
+ */
+bool trace_enqueue(void);
+
+/**
+ * @brief Get the latency statistics for a stage.
+ *
+ * @param stage The stage.
+ * @return const trace_stat_s* Pointer to the statistics.
+ */
+const trace_stat_s* trace_stats(trace_stage_e stage);
+
+/**
+ * @brief Get the average latency for a stage.
+ *
+ * @param stage The stage.
+ * @return u16 Average latency in microseconds, 0 if there are no samples.
+ */
+u16 trace_avg(trace_stage_e stage);
+
+/**
+ * @brief Clear all statistics and abandon the trace in flight.
+ */
+void trace_reset(void);
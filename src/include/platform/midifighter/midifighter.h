@@ -26,6 +26,14 @@
 #define MF_NUM_INPUT_SHIFT_REGISTERS (6)
 #define MF_NUM_PWM_FRAMES						 (32)
 
+// Encoder scan rate (timer ISR). The input shift registers are read by the
+// USART (SPI) and DMA, define MF_ENC_SCAN_GPIO to bit-bang them instead.
+#ifdef MF_ENC_SCAN_GPIO
+#define MF_ENC_SCAN_HZ							 (2000)
+#else
+#define MF_ENC_SCAN_HZ							 (4000)
+#endif
+
 #define MF_MAX_BRIGHTNESS						 (MF_NUM_PWM_FRAMES)
 #define MF_MIN_BRIGHTNESS						 (1)
 
@@ -33,6 +41,16 @@
 #define MF_NUM_ENC_PER_BANK					 (MF_NUM_ENCODERS)
 #define MF_NUM_VMAPS_PER_ENC				 (2)
 
+// Bit of the encoder switch in mf_encoder_s.gates, after one bit per vmap
+#define MF_GATE_SW									 (1u << MF_NUM_VMAPS_PER_ENC)
+#define MF_NUM_GATES_PER_ENC				 (MF_NUM_VMAPS_PER_ENC + 1)
+
+// Set in mf_gate_s.channel when the gate is a CC (switch only)
+#define MF_GATE_CC									 (0x80)
+
+// Bank change feedback is sent as CC <bank> = 127 on this channel
+#define MF_BANK_FEEDBACK_CHANNEL		 (3)
+
 #define MF_RGB_WHITE								 (0x32DF) // red = max, blue = 12, green = 22
 #define MF_RGB_MAX_VAL							 (MF_NUM_PWM_FRAMES)
 
@@ -71,6 +89,31 @@ typedef enum {
 	SW_MODE_MIDI,
 } switch_mode_e;
 
+typedef enum {
+	SIDE_SW_MODE_NONE,
+
+	// Select the previous/next bank on press (wraps around)
+	SIDE_SW_MODE_BANK_PREV,
+	SIDE_SW_MODE_BANK_NEXT,
+
+	// Select the bank set in mf_side_switch_s on press
+	SIDE_SW_MODE_BANK_DIRECT,
+
+	SIDE_SW_MODE_NB,
+} side_switch_mode_e;
+
+typedef struct {
+	u8 mode; // side_switch_mode_e
+	u8 bank; // Target bank for SIDE_SW_MODE_BANK_DIRECT
+} mf_side_switch_s;
+
+// The on of a gate, the off is sent to the same channel and note even when
+// the configuration has changed since
+typedef struct {
+	u8 channel; // MIDI channel, with MF_GATE_CC for a CC gate
+	u8 note;		// Note (or CC) number
+} mf_gate_s;
+
 typedef struct {
 	// Hardware index (0 to 15)
 	u8 idx;
@@ -86,6 +129,10 @@ typedef struct {
 	encoder_s			enc_ctx;
 	quadrature_s* quad_ctx;
 
+	// Fine adjust, the velocity is divided by fine_div while active
+	bool fine;
+	u8	 fine_div;
+
 	// Virtual Mappings
 	virtmap_mode_e vmap_mode;
 	u8						 vmap_active; // Index for the current active vmap
@@ -96,26 +143,32 @@ typedef struct {
 	switch_mode_e	 sw_mode;
 	proto_cfg_s		 sw_cfg;
 
+	// Notes (and switch CC gates) that are on, a bit per vmap and MF_GATE_SW
+	u8				gates;
+	mf_gate_s gate[MF_NUM_GATES_PER_ENC];
+
+	// Gates that are released but still on, the off did not fit in the queue
+	u8 gates_off;
+
 	/*
 		update_display is (as its name suggests) used to determine when to redraw
-		the LEDs for this encoder. This is to prevent the display from being updated
-		too frequently, and to allow for a smooth display update.
-		It is effectively a timestamp (in ms) which can then be used to determine
-		if the display should be updated.
-		Normally the display only needs to be updated if the time delta between
-		the last update and the current time is greater than a certain threshold.
-
-		A value of 0 means the display is up-to-date (and can therefore be skipped
-		by the update routine).
+		the LEDs for this encoder. It is set when the encoder changes, and the
+		encoder is redrawn (and the flag cleared) on the next periodic display
+		refresh event. This prevents the display from being updated too
+		frequently, and allows for a smooth display update.
 	*/
-	u32 update_display;
+	bool update_display;
 } mf_encoder_s;
 
 /**
  * @brief Runtime data structure for the midifighter global variables.
  */
 typedef struct {
-	u8 curr_bank;
+	u8							 curr_bank;
+	mf_side_switch_s side_sw[MF_NUM_SIDE_SWITCHES];
+
+	// Send a CC on MF_BANK_FEEDBACK_CHANNEL when the bank changes
+	bool bank_feedback;
 } mf_rt_s;
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -132,18 +185,112 @@ extern sys_config_s gCONFIG;
 
 void hw_led_init(void);
 
+/**
+ * @brief Initialise the encoder shift registers and start the scan timer.
+ * Encoders are scanned at MF_ENC_SCAN_HZ from a timer ISR, detents are
+ * accumulated in gQUAD_ENC (see quadrature_steps()).
+ */
 void hw_encoder_init(void);
-void hw_encoder_scan(void);
+
+/**
+ * @brief Fetch the encoder switch edges debounced by the scan ISR.
+ * Called from the main loop, before reading hw_enc_switch_state().
+ */
+void hw_encoder_update(void);
+
+/**
+ * @brief Get the encoders that reached a detent since the last call, bit n is
+ * encoder n. The mask is cleared by the call.
+ */
+u16 hw_encoder_moved(void);
+
+/**
+ * @brief Get the encoder switches that were pressed/released by the last
+ * hw_encoder_update(), bit n is switch n.
+ */
+u16 hw_enc_switch_pressed(void);
+u16 hw_enc_switch_released(void);
 
 void					 hw_switch_init(void);
 void					 hw_switch_update(void);
+u8						 hw_switch_pressed(void);
+u8						 hw_switch_released(void);
 switch_state_e hw_enc_switch_state(u8 idx);
 
 void mf_input_init(void);
 void mf_input_update(void);
 bool mf_is_reset_pressed(void);
+int	 mf_input_midi_handler(void* evt);
+int	 mf_input_gesture_handler(void* evt);
+
+/**
+ * @brief Make a bank active. Only the encoders whose LEDs differ between the
+ * banks are redrawn, and no values are sent for the new bank.
+ *
+ * @param bank Bank index, 0 to MF_NUM_ENC_BANKS - 1.
+ * @return int 0 on success, ERR_BAD_PARAM for an invalid bank.
+ */
+int mf_bank_select(u8 bank);
+
+/**
+ * @brief Send a note off (or CC gate off) for every note that is on, and
+ * forget them. Called when the host (re)connects, bank changes do this for
+ * the bank being left.
+ */
+void mf_notes_off(void);
+
+/**
+ * @brief Apply the gesture times in gCONFIG to the encoder switch gestures,
+ * call after gesture_long_time or gesture_double_time has changed.
+ */
+void mf_gesture_cfg_update(void);
+
+/**
+ * @brief Send the off of a gate (a vmap index, or MF_NUM_VMAPS_PER_ENC for
+ * the switch) if it is on. Call after its protocol configuration has changed,
+ * a held note is not carried over to the new configuration.
+ */
+void mf_gate_release(mf_encoder_s* enc, u8 gate);
+
+/**
+ * @brief Recalculate the cached scale factors of a virtual mapping, call after
+ * its range, position or protocol configuration has changed.
+ */
+void mf_vmap_scale_update(virtmap_s* vmap);
+
+/**
+ * @brief Rebuild the reverse index from MIDI (channel, CC) to virtual
+ * mappings. Must be called after the mappings are (re)loaded.
+ */
+void mf_vmap_index_init(void);
+
+/**
+ * @brief Update the index for a single virtual mapping, call after its
+ * protocol configuration has changed.
+ */
+void mf_vmap_index_update(u8 bank, u8 enc, u8 vmap);
+
+/**
+ * @brief Find the virtual mappings that use a MIDI channel and CC.
+ *
+ * @param channel MIDI channel (0 to 15).
+ * @param cc Control number.
+ * @param first Set to the index position of the first match.
+ * @return u8 Number of matches, at positions first to first + count - 1.
+ */
+u8 mf_vmap_index_find(u8 channel, u8 cc, u8* first);
+
+/**
+ * @brief Resolve an index position (see mf_vmap_index_find()).
+ *
+ * @param pos Index position.
+ * @param vmap Set to the index of the virtual mapping within the encoder.
+ * @return mf_encoder_s* The encoder that owns the virtual mapping.
+ */
+mf_encoder_s* mf_vmap_index_get(u8 pos, u8* vmap);
 
 int mf_display_init(void);
+int mf_display_refresh_handler(void* event);
 int mf_draw_encoder(mf_encoder_s* enc);
 
 void mf_debug_encoder_set_indicator(u8 indicator, u8 state);
@@ -161,7 +308,7 @@ void mf_debug_encoder_set_rgb(bool red, bool green, bool blue);
 int mf_cfg_init(void);
 int mf_cfg_load(void);
 int mf_cfg_store(void);
-int mf_cfg_update(void);
 int mf_cfg_reset(void);
+int mf_cfg_sys_handler(void* event);
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -8,6 +8,7 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 #include "platform/midifighter/midifighter.h"
+#include "event/event.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -43,13 +44,51 @@ typedef enum {
 	MF_SYSEX_PARAM_VMAP_RGB,
 	MF_SYSEX_PARAM_VMAP_RB,
 	MF_SYSEX_PARAM_VMAP_PROTO,
+	MF_SYSEX_PARAM_VMAP_PICKUP, // GET replies [bank, enc, vmap, lagging, mode]
 
 	MF_SYSEX_PARAM_SIDE_SWITCH,
 	MF_SYSEX_PARAM_ACTIVE_BANK,
 
+	MF_SYSEX_PARAM_EVENT_STATS, // GET only
+	MF_SYSEX_PARAM_TRACE,				// GET only
+
+	MF_SYSEX_PARAM_GESTURE_TIME, // [item, ms bits 13-7, ms bits 6-0]
+
 	MF_SYSEX_PARAM_NB,
 } mf_sysex_param_e;
 
+// Items that can be requested with MF_SYSEX_PARAM_EVENT_STATS
+typedef enum {
+	MF_SYSEX_STATS_POSTS,
+	MF_SYSEX_STATS_DROPS,
+	MF_SYSEX_STATS_HIGH_WATER,
+	MF_SYSEX_STATS_HANDLER_CALLS,
+
+	// Followed by EVENT_HIST_BUCKETS items, one per bucket
+	MF_SYSEX_STATS_QUEUE_HIST,
+	MF_SYSEX_STATS_HANDLER_HIST = MF_SYSEX_STATS_QUEUE_HIST + EVENT_HIST_BUCKETS,
+
+	MF_SYSEX_STATS_NB = MF_SYSEX_STATS_HANDLER_HIST + EVENT_HIST_BUCKETS,
+} mf_sysex_stats_item_e;
+
+// Items that can be requested with MF_SYSEX_PARAM_TRACE
+typedef enum {
+	MF_SYSEX_TRACE_MIN,
+	MF_SYSEX_TRACE_AVG,
+	MF_SYSEX_TRACE_MAX,
+	MF_SYSEX_TRACE_COUNT,
+
+	MF_SYSEX_TRACE_NB,
+} mf_sysex_trace_item_e;
+
+// Items that can be set with MF_SYSEX_PARAM_GESTURE_TIME
+typedef enum {
+	MF_SYSEX_GESTURE_LONG,	 // Long press hold time (ms), at least 1
+	MF_SYSEX_GESTURE_DOUBLE, // Double click gap (ms), 0 disables double clicks
+
+	MF_SYSEX_GESTURE_NB,
+} mf_sysex_gesture_item_e;
+
 typedef struct __attribute__((packed)) {
 	u8 mode;
 	u8 channel;
@@ -85,8 +124,15 @@ typedef struct __attribute__((packed)) {
 
 typedef struct __attribute__((packed)) {
 	u8 sw_idx;
+	u8 mode; // side_switch_mode_e
+	u8 bank; // Target bank for SIDE_SW_MODE_BANK_DIRECT
 } mf_sysex_sideswitch_param_s;
 
+typedef struct __attribute__((packed)) {
+	u8 bank_idx;
+	u8 feedback; // Send a CC when the bank changes (see mf_rt_s)
+} mf_sysex_bank_param_s;
+
 typedef struct __attribute__((packed)) {
 	u8 bank_idx;
 	u8 enc_idx;
@@ -109,13 +155,34 @@ typedef struct __attribute__((packed)) {
 			u16 red;
 			u16 blue;
 		} rb;
+		u8 pickup; // virtmap_pickup_e
 	} data;
 } mf_sysex_vmap_param_s;
 
+typedef struct __attribute__((packed)) {
+	u8 channel; // event_ch_e
+	u8 item;		// mf_sysex_stats_item_e
+} mf_sysex_stats_param_s;
+
+typedef struct __attribute__((packed)) {
+	u8 stage; // trace_stage_e
+	u8 item;	// mf_sysex_trace_item_e
+} mf_sysex_trace_param_s;
+
+typedef struct __attribute__((packed)) {
+	u8 item; // mf_sysex_gesture_item_e
+	u8 msb;	 // Time bits 13-7
+	u8 lsb;	 // Time bits 6-0
+} mf_sysex_gesture_param_s;
+
 typedef union {
 	mf_sysex_encoder_param_s		enc;
 	mf_sysex_sideswitch_param_s sw;
+	mf_sysex_bank_param_s				bank;
 	mf_sysex_vmap_param_s				vmap;
+	mf_sysex_stats_param_s			stats;
+	mf_sysex_trace_param_s			trace;
+	mf_sysex_gesture_param_s		gesture;
 } mf_sysex_param_s;
 
 typedef struct __attribute__((packed)) {
@@ -128,4 +195,10 @@ typedef struct __attribute__((packed)) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int mf_sysex_init(void);
+/**
+ * @brief Event handler for sysex messages on EVENT_CHANNEL_MIDI_IN.
+ *
+ * @param evt Pointer to the midi event.
+ * @return int General error code.
+ */
+int mf_sysex_midi_handler(void* evt);
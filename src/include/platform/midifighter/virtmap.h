@@ -8,6 +8,7 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 #include "sys/types.h"
+#include "sys/utility.h"
 #include "protocol/protocol.h"
 #include "platform/midifighter/rgb.h"
 
@@ -38,6 +39,33 @@ typedef enum {
 	VIRTMAP_DISPLAY_NB,
 } virtmap_display_mode_e;
 
+/**
+ * @brief How a virtual mapping takes over from a value set by the host.
+ * The position follows the host value and is shown on the LEDs, what differs
+ * is how the controller gets back in control (see virtmap_s lagging).
+ */
+typedef enum {
+	/**
+	 * @brief Turning continues from the host value, there is no lag.
+	 */
+	VIRTMAP_PICKUP_JUMP,
+
+	/**
+	 * @brief Turning has no effect until the controller reaches or crosses the
+	 * host value.
+	 */
+	VIRTMAP_PICKUP_CATCH,
+
+	/**
+	 * @brief Turning moves the value in proportion to the room left before the
+	 * end of the range, so that the value and controller meet at the latest
+	 * at the end.
+	 */
+	VIRTMAP_PICKUP_SCALE,
+
+	VIRTMAP_PICKUP_NB,
+} virtmap_pickup_e;
+
 typedef struct virtmap_s {
 	/**
 	 * @brief The lower and upper range determine the numerical values that will
@@ -74,17 +102,30 @@ typedef struct virtmap_s {
 	 *
 	 * Note that the start and stop values are not percentages, they are a
 	 * 8-bit value. To calculate percentages use the appropriate defines for
-	 * min/max encoder value.
+	 * min/max encoder value. The stop value includes all of the sub-LED
+	 * positions within it, see curr_pos.
 	 */
 	struct {
 		u8 start;
 		u8 stop;
 	} position;
 
-	u8					curr_pos;
+	u16					curr_pos; // Position with sub-LED resolution (see ENC_POS)
 	i16					curr_val;
+	i16					rel_acc; // Relative movement not sent yet (positions)
 	proto_cfg_s cfg;
 
+	// Soft takeover, while lagging the controller is at ctrl_pos and curr_pos
+	// holds the host value.
+	u8	 pickup; // virtmap_pickup_e
+	bool lagging;
+	u16	 ctrl_pos;
+
+	// Position to value and value to position scale factors, derived from the
+	// range, position and protocol (see mf_vmap_scale_update()).
+	scale_s to_val;
+	scale_s to_pos;
+
 	rgb_8_s rgb;
 	rb_8_s	rb;
 } virtmap_s;
@@ -8,12 +8,123 @@
 
 #include <stdio.h>
 
+#include "sys/time.h"
+#include "event/event.h"
+#include "event/sys.h"
+#include "event/io.h"
+#include "event/midi.h"
+#include "trace/trace.h"
+#include "input/encoder.h"
+#include "input/quadrature.h"
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// Synthetic load, bursts are larger than the IO queue to exercise drops
+#define HOST_NUM_BURSTS				(4)
+#define HOST_BURST_SIZE				(48)
+#define HOST_PASSES_PER_BURST (4)
+#define HOST_HANDLER_WORK			(2000)
+
+// Simulated USB output path, the inputs are spread over a few controls
+#define HOST_MIDI_QUEUE_BYTES (128)
+#define HOST_MIDI_CONTROLS		(4)
+#define HOST_USB_WORK					(500)
+
+// Encoder acceleration benchmark, a sweep from slow to fast rotation
+#define HOST_ENC_UPDATES		(200000)
+#define HOST_ENC_PERIOD_MAX (60) // Slowest detent period (ms)
+
+// Quadrature decoder check, every input sequence of this many steps is run in
+// every lane. Six steps reach every decoder state before the last input.
+#define HOST_QUAD_STEPS (6)
+#define HOST_QUAD_LANES (16)
+
+// Overflow policy check, a small channel (in the unused MIDI in slot) gets
+// a few more events than it holds. The repost is posted by the handler.
+#define HOST_CHECK_QUEUE		(16)
+#define HOST_CHECK_EXTRA		(3)
+#define HOST_CHECK_BLOCK_US (1000)
+#define HOST_CHECK_REPOST		(0x80)
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef struct __attribute__((packed)) {
+	u8 type;
+	u8 seq; // Post order
+} check_event_s;
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int	io_handler(void* evt);
+static int	midi_out_handler(void* evt);
+static void print_stats(event_ch_e ch, const char* name);
+static void print_trace(void);
+static void bench_encoder(void);
+static uint check_quadrature(void);
+static uint check_overflow(void);
+static uint check_policy(bool variable, u8 policy);
+static uint check_repost(bool variable, u8 policy);
+static uint check_timer(void);
+static int	check_begin(bool variable, u8 policy, u8 action);
+static uint check_end(uint first, uint count, bool last, uint drops);
+static int	check_handler(void* evt);
+static void check_lost(event_ch_e ch, event_overflow_e action);
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static u8 midi_out_event_queue[HOST_MIDI_QUEUE_BYTES];
+
+static const event_ch_handler_s io_handlers[] = {
+		EVT_HANDLER(EVT_TYPES_ALL, io_handler),
+};
+
+static const event_ch_handler_s midi_out_handlers[] = {
+		EVT_HANDLER(EVT_TYPES_ALL, midi_out_handler),
+};
+
+static const event_ch_handler_s check_handlers[] = {
+		EVT_HANDLER(EVT_TYPES_ALL, check_handler),
+};
+
+static u8 check_queue[HOST_CHECK_QUEUE * sizeof(check_event_s)];
+
+// The policy and variable fields are set by check_begin()
+static event_channel_s check_ch = {
+		.queue			 = check_queue,
+		.queue_size	 = HOST_CHECK_QUEUE,
+		.data_size	 = sizeof(check_event_s),
+		.block_us		 = HOST_CHECK_BLOCK_US,
+		.on_overflow = check_lost,
+};
+
+// Events seen by check_handler(), and the drops seen by check_lost()
+static u8		check_seen[HOST_CHECK_QUEUE + HOST_CHECK_EXTRA + 1];
+static uint check_seen_count;
+static uint check_drops;
+static uint check_bad_action;
+static u8		check_action;
+static bool check_reposting;
+
+event_channel_s midi_out_event_ch = {
+		.queue			= midi_out_event_queue,
+		.queue_size = HOST_MIDI_QUEUE_BYTES,
+		.data_size	= sizeof(midi_event_s),
+		.variable		= true,
+		.quantum		= 0,
+		.guaranteed = true,
+		.merge			= midi_event_merge,
+};
+
+const event_ch_def_s gEVENT_CHANNELS[EVENT_CHANNEL_NB] = {
+		[EVENT_CHANNEL_SYS]			 = EVT_CHANNEL_NO_HANDLERS(&sys_event_ch),
+		[EVENT_CHANNEL_IO]			 = EVT_CHANNEL(&io_event_ch, io_handlers),
+		[EVENT_CHANNEL_MIDI_IN]	 = EVT_CHANNEL(&check_ch, check_handlers),
+		[EVENT_CHANNEL_MIDI_OUT] =
+				EVT_CHANNEL(&midi_out_event_ch, midi_out_handlers),
+};
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 // Entry point
@@ -21,8 +132,361 @@ int main(int argc, char* argv[]) {
 	(void)argc;
 	(void)argv;
 
-	printf("hello world\r\n");
-	return 0;
+	systime_start();
+
+	int ret = event_init();
+	RETURN_ON_ERR(ret);
+
+	for (uint b = 0; b < HOST_NUM_BURSTS; b++) {
+		for (uint i = 0; i < HOST_BURST_SIZE; i++) {
+			// Each synthetic input edge is a trace candidate, they all come
+			// from the same input
+			TRACE_START(0);
+			io_event_s evt = {.type = EVT_IO_ENCODER_ROTATION, .ctx = NULL};
+			event_post(EVENT_CHANNEL_IO, &evt);
+		}
+
+		for (uint p = 0; p < HOST_PASSES_PER_BURST; p++) {
+			ret = event_update(0);
+			RETURN_ON_ERR(ret);
+		}
+	}
+
+	print_stats(EVENT_CHANNEL_SYS, "sys");
+	print_stats(EVENT_CHANNEL_IO, "io");
+	print_stats(EVENT_CHANNEL_MIDI_OUT, "midi out");
+	print_trace();
+	bench_encoder();
+
+	// The checks are the only results that can fail, the overflow check
+	// re-initialises the event system so it runs last.
+	uint failures = check_quadrature();
+	failures += check_overflow();
+	return (failures == 0) ? 0 : 1;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int io_handler(void* evt) {
+	(void)evt;
+
+	// Stand-in for the work done by a real handler
+	for (volatile uint i = 0; i < HOST_HANDLER_WORK; i++) {
+	}
+
+	// Forward the input as a MIDI value, like the input manager
+	static u8 control = 0;
+
+	midi_event_s midi = {
+			.type						 = MIDI_EVENT_CC_VALUE,
+			.data.cc.control = control,
+	};
+	control = (u8)((control + 1) % HOST_MIDI_CONTROLS);
+
+	TRACE_INPUT(0);
+	int ret = event_post_size(EVENT_CHANNEL_MIDI_OUT, &midi, MIDI_CC_EVENT_SIZE);
+	TRACE_INPUT(TRACE_INPUT_NONE);
+	return ret;
+}
+
+static int midi_out_handler(void* evt) {
+	(void)evt;
+
+	// Stand-in for the USB endpoint write
+	for (volatile uint i = 0; i < HOST_USB_WORK; i++) {
+	}
+
+	TRACE_MARK(TRACE_STAGE_USB);
+	return 0;
+}
+
+static void print_stats(event_ch_e ch, const char* name) {
+	const event_ch_stats_s* stats = event_channel_stats(ch);
+	if (stats == NULL) {
+		return;
+	}
+
+	printf("[%s] posts: %u, drops: %u, merges: %u, high water: %u, "
+				 "handler calls: %u\r\n",
+				 name, stats->posts, stats->drops, stats->merges, stats->high_water,
+				 stats->handler_calls);
+
+#ifdef EVENT_HIST_ENABLE
+	for (uint i = 0; i < EVENT_HIST_BUCKETS; i++) {
+		bool last	 = (i == (EVENT_HIST_BUCKETS - 1));
+		uint bound = 1u << (EVENT_HIST_BASE_SHIFT + i - (last ? 1 : 0));
+		printf("[%s] %s %5uus: queue %5u, handler %5u\r\n", name,
+					 last ? ">=" : "< ", bound, stats->queue_hist[i],
+					 stats->handler_hist[i]);
+	}
+#endif
+}
+
+static void print_trace(void) {
+#ifdef TRACE_ENABLE
+	static const char* const names[TRACE_STAGE_NB] = {
+			[TRACE_STAGE_CREATE]	 = "create",
+			[TRACE_STAGE_ENQUEUE]	 = "enqueue",
+			[TRACE_STAGE_DISPATCH] = "dispatch",
+			[TRACE_STAGE_USB]			 = "usb",
+	};
+
+	for (uint i = 0; i < TRACE_STAGE_NB; i++) {
+		const trace_stat_s* s = trace_stats(i);
+		printf("[trace] %-8s count %5u, min %5uus, avg %5uus, max %5uus\r\n",
+					 names[i], s->count, s->min, trace_avg(i), s->max);
+	}
+#endif
+}
+
+static void bench_encoder(void) {
+	static const char* const names[ENC_ACCEL_NB] = {
+			[ENC_ACCEL_NONE]	 = "none",
+			[ENC_ACCEL_LINEAR] = "linear",
+			[ENC_ACCEL_EXP]		 = "exp",
+			[ENC_ACCEL_TABLE]	 = "table",
+	};
+
+	for (uint m = 0; m < ENC_ACCEL_NB; m++) {
+		encoder_s enc;
+		encoder_init(&enc);
+		enc.accel_mode = (u8)m;
+
+		// The time is simulated, so the velocities (and the sum) only depend on
+		// the algorithm, not on the host.
+		u16 now = 0;
+		i32 sum = 0;
+		i16 max = 0;
+
+		const u32 start = systime_us();
+		for (uint i = 0; i < HOST_ENC_UPDATES; i++) {
+			now += (u16)(HOST_ENC_PERIOD_MAX - (i % HOST_ENC_PERIOD_MAX));
+			encoder_update(&enc, 1, now);
+			sum += enc.velocity;
+			max = (enc.velocity > max) ? enc.velocity : max;
+		}
+		const u32 elapsed = systime_us() - start;
+
+		printf("[accel] %-6s sum %8ld, max %4d, %4u ns/update\r\n", names[m],
+					 (long)sum, max, (uint)((elapsed * 1000ul) / HOST_ENC_UPDATES));
+	}
+}
+
+/*
+	Compare the bit-sliced decoder with quadrature_update() (the quad_states[]
+	table) for every input sequence in every lane. The lanes run different
+	sequences, so a lane that leaks into another is caught as well. Returns
+	the number of mismatched detents.
+*/
+static uint check_quadrature(void) {
+	const uint seqs				= 1u << (2 * HOST_QUAD_STEPS);
+	uint			 mismatches = 0;
+
+	for (uint p = 0; p < seqs; p++) {
+		quadrature_x16_s x16									= {0};
+		quadrature_s		 ref[HOST_QUAD_LANES] = {0};
+
+		for (uint k = 0; k < HOST_QUAD_STEPS; k++) {
+			u16 ch_a = 0;
+			u16 ch_b = 0;
+
+			// Two bits of the lane's sequence per step, A then B
+			for (uint l = 0; l < HOST_QUAD_LANES; l++) {
+				const uint seq = (p + l * 257u) % seqs;
+				const uint a	 = (seq >> (2 * k)) & 0x01;
+				const uint b	 = (seq >> (2 * k + 1)) & 0x01;
+
+				ch_a |= (u16)(a << l);
+				ch_b |= (u16)(b << l);
+				quadrature_update(&ref[l], a, b);
+			}
+
+			u16 cw, ccw;
+			quadrature_x16_update(&x16, ch_a, ch_b, &cw, &ccw);
+
+			for (uint l = 0; l < HOST_QUAD_LANES; l++) {
+				int dir = 0;
+				if (cw & (1u << l)) {
+					dir = 1;
+				} else if (ccw & (1u << l)) {
+					dir = -1;
+				}
+
+				if (dir != quadrature_direction(&ref[l])) {
+					mismatches++;
+				}
+			}
+		}
+	}
+
+	printf("[quad] %u sequences of %u steps in %u lanes, %u mismatches\r\n",
+				 seqs, HOST_QUAD_STEPS, HOST_QUAD_LANES, mismatches);
+
+	return mismatches;
+}
+
+/*
+	Run every overflow policy on a fixed and a variable channel, and check
+	that DROP_OLDEST and BLOCK fall back to REJECT_NEW where they must not
+	touch the consumer side. Returns the number of failed runs.
+*/
+static uint check_overflow(void) {
+	uint runs			= 0;
+	uint failures = 0;
+
+	for (uint v = 0; v < 2; v++) {
+		for (u8 p = 0; p < EVENT_OVERFLOW_NB; p++) {
+			failures += check_policy(v, p);
+			runs++;
+
+			if (p == EVENT_OVERFLOW_DROP_OLDEST || p == EVENT_OVERFLOW_BLOCK) {
+				failures += check_repost(v, p);
+				runs++;
+			}
+		}
+	}
+
+	failures += check_timer();
+	runs++;
+
+	printf("[overflow] %u runs, %u failures\r\n", runs, failures);
+	return failures;
+}
+
+// Post HOST_CHECK_EXTRA more events than the channel holds
+static uint check_policy(bool variable, u8 policy) {
+	int ret = check_begin(variable, policy, policy);
+
+	// Not supported, the channel definition must be rejected
+	if (variable && policy == EVENT_OVERFLOW_OVERWRITE_LAST) {
+		return (ret == ERR_BAD_PARAM) ? 0 : 1;
+	} else if (ret != 0) {
+		return 1;
+	}
+
+	// A variable event also takes its length byte
+	const uint cap	 = variable ? HOST_CHECK_QUEUE / (1 + sizeof(check_event_s))
+															: HOST_CHECK_QUEUE;
+	const uint posts = cap + HOST_CHECK_EXTRA;
+	const uint extra = HOST_CHECK_EXTRA;
+
+	for (uint i = 0; i < posts; i++) {
+		check_event_s evt = {.type = 0, .seq = (u8)i};
+		event_post(EVENT_CHANNEL_MIDI_IN, &evt);
+	}
+
+	switch (policy) {
+		case EVENT_OVERFLOW_DROP_OLDEST: return check_end(extra, cap, false, extra);
+		case EVENT_OVERFLOW_OVERWRITE_LAST: return check_end(0, cap, true, extra);
+		case EVENT_OVERFLOW_BLOCK: return check_end(0, posts, false, 0);
+		default: return check_end(0, cap, false, extra);
+	}
+}
+
+// A handler posting to its own full channel, its event is rejected
+static uint check_repost(bool variable, u8 policy) {
+	if (check_begin(variable, policy, EVENT_OVERFLOW_REJECT_NEW) != 0) {
+		return 1;
+	}
+
+	uint cap = 0;
+	for (;; cap++) {
+		check_event_s evt = {.type = 0, .seq = (u8)cap};
+		if (!event_space(EVENT_CHANNEL_MIDI_IN, sizeof(evt), 1)) {
+			break;
+		}
+		event_post(EVENT_CHANNEL_MIDI_IN, &evt);
+	}
+
+	check_reposting = true;
+	return check_end(0, cap, false, 1);
+}
+
+// A delayed event for a full BLOCK channel is rejected, no handler runs
+// while the timer wheel is posting
+static uint check_timer(void) {
+	int ret = check_begin(false, EVENT_OVERFLOW_BLOCK, EVENT_OVERFLOW_REJECT_NEW);
+	if (ret != 0) {
+		return 1;
+	}
+
+	check_event_s evt = {.type = 0, .seq = HOST_CHECK_REPOST};
+	if (event_post_delayed(EVENT_CHANNEL_MIDI_IN, &evt, 1, NULL) != 0) {
+		return 1;
+	}
+
+	for (uint i = 0; i < HOST_CHECK_QUEUE; i++) {
+		evt.seq = (u8)i;
+		event_post(EVENT_CHANNEL_MIDI_IN, &evt);
+	}
+
+	const u32 start = systime_ms();
+	while ((systime_ms() - start) < 2) {
+	}
+
+	event_update(0);
+	return check_end(0, HOST_CHECK_QUEUE, false, 1);
+}
+
+// Reset the event system with the check channel set up for one run
+static int check_begin(bool variable, u8 policy, u8 action) {
+	check_ch.variable = variable;
+	check_ch.overflow = policy;
+
+	check_seen_count = 0;
+	check_drops			 = 0;
+	check_bad_action = 0;
+	check_action		 = action;
+	check_reposting	 = false;
+
+	return event_init();
+}
+
+/*
+	Process the check channel and compare the events seen with the sequence
+	first to first + count - 1, where last replaces the final event with the
+	last one posted. Returns 1 on a mismatch.
+*/
+static uint check_end(uint first, uint count, bool last, uint drops) {
+	event_channel_process(EVENT_CHANNEL_MIDI_IN);
+
+	const event_ch_stats_s* stats	 = event_channel_stats(EVENT_CHANNEL_MIDI_IN);
+	uint										failed = (check_seen_count != count);
+
+	for (uint i = 0; !failed && i < count; i++) {
+		uint seq = first + i;
+		if (last && i == count - 1) {
+			seq = count - 1 + drops;
+		}
+		failed |= (check_seen[i] != seq);
+	}
+
+	failed |= (stats->drops != drops) || (check_drops != drops);
+	failed |= (check_bad_action != 0);
+	return failed ? 1 : 0;
+}
+
+static int check_handler(void* evt) {
+	const check_event_s* check = evt;
+
+	if (check_seen_count < COUNTOF(check_seen)) {
+		check_seen[check_seen_count++] = check->seq;
+	}
+
+	// The channel is still full, the oldest event is being processed
+	if (check_reposting) {
+		check_reposting = false;
+
+		check_event_s again = {.type = 0, .seq = HOST_CHECK_REPOST};
+		event_post(EVENT_CHANNEL_MIDI_IN, &again);
+	}
+
+	return 0;
+}
+
+static void check_lost(event_ch_e ch, event_overflow_e action) {
+	check_drops++;
+	if (ch != EVENT_CHANNEL_MIDI_IN || action != check_action) {
+		check_bad_action++;
+	}
+}
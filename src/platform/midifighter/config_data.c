@@ -10,12 +10,18 @@
 #include <avr/eeprom.h>
 
 #include "sys/error.h"
-#include "sys/time.h"
+#include "event/event.h"
+#include "event/sys.h"
 #include "platform/midifighter/midifighter.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-#define EE_VERSION (u16)(11)
+#define EE_VERSION (u16)(15)
+
+STATIC_ASSERT(ENC_ACCEL_NB <= 4, "accel_mode is stored in 2 bits");
+
+// Interval between configuration saves (only changed bytes are written)
+#define CFG_SAVE_INTERVAL_MS (1000)
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -56,9 +62,10 @@ typedef struct {
 
 	// Encoder
 	u8 detent											 : 1;
-	u8 accel_mode									 : 1;
+	u8 accel_mode									 : 2;
 	u8 vmap_mode									 : 1;
 	u8 vmap_active								 : 1;
+	u8 fine_div;
 
 	// Encoder Switch
 	u8										sw_state : 1;
@@ -67,7 +74,8 @@ typedef struct {
 
 	struct {
 		mf_eeprom_proto_cfg_s cfg;
-		u8										pos;
+		u16										pos;
+		u8										pickup;
 		u8										rgb_r;
 		u8										rgb_g;
 		u8										rgb_b;
@@ -130,7 +138,10 @@ int mf_cfg_init(void) {
 		init_eeprom();
 	}
 
-	return 0;
+	// Save the configuration periodically
+	event_sys_s save = {.type = EVT_SYS_REQ_CFG_SAVE, .data = NULL};
+	return event_post_periodic(EVENT_CHANNEL_SYS, &save, CFG_SAVE_INTERVAL_MS,
+														 NULL);
 }
 
 int mf_cfg_load(void) {
@@ -144,6 +155,7 @@ int mf_cfg_load(void) {
 		}
 	}
 
+	mf_vmap_index_init();
 	return 0;
 }
 
@@ -162,17 +174,11 @@ int mf_cfg_store(void) {
 	return 0;
 }
 
-int mf_cfg_update(void) {
-	static uint32_t last_update = 0;
-	uint32_t				time_now		= systime_ms();
+int mf_cfg_sys_handler(void* event) {
+	(void)event;
 
-	// Update every 1 second
-	if ((time_now - last_update) > 1000) {
-		mf_cfg_store();
-		last_update = time_now;
-	}
-
-	return 0;
+	// Only registered for EVT_SYS_REQ_CFG_SAVE, see event_table.c
+	return mf_cfg_store();
 }
 
 int mf_cfg_reset(void) {
@@ -193,14 +199,16 @@ int encode_encoder(const mf_encoder_s* src, mf_eeprom_encoder_s* dst) {
 	dst->sw_mode			= src->sw_mode;
 	dst->sw_state			= src->sw_state;
 	dst->vmap_active	= src->vmap_active;
+	dst->fine_div			= src->fine_div;
 
 	for (int i = 0; i < MF_NUM_VMAPS_PER_ENC; i++) {
-		dst->vmap[i].pos	 = src->vmaps[i].curr_pos;
-		dst->vmap[i].rgb_r = src->vmaps[i].rgb.red;
-		dst->vmap[i].rgb_g = src->vmaps[i].rgb.green;
-		dst->vmap[i].rgb_b = src->vmaps[i].rgb.blue;
-		dst->vmap[i].rb_r	 = src->vmaps[i].rb.red;
-		dst->vmap[i].rb_b	 = src->vmaps[i].rb.blue;
+		dst->vmap[i].pos		= src->vmaps[i].curr_pos;
+		dst->vmap[i].pickup	= src->vmaps[i].pickup;
+		dst->vmap[i].rgb_r	= src->vmaps[i].rgb.red;
+		dst->vmap[i].rgb_g	= src->vmaps[i].rgb.green;
+		dst->vmap[i].rgb_b	= src->vmaps[i].rgb.blue;
+		dst->vmap[i].rb_r		= src->vmaps[i].rb.red;
+		dst->vmap[i].rb_b		= src->vmaps[i].rb.blue;
 		encode_proto_cfg(&src->vmaps[i].cfg, &dst->vmap[i].cfg);
 	}
 
@@ -221,15 +229,19 @@ int decode_encoder(const mf_eeprom_encoder_s* src, mf_encoder_s* dst) {
 	dst->sw_mode						= src->sw_mode;
 	dst->sw_state						= src->sw_state;
 	dst->vmap_active				= src->vmap_active;
+	dst->fine_div						= src->fine_div;
 
 	for (int i = 0; i < MF_NUM_VMAPS_PER_ENC; i++) {
 		dst->vmaps[i].curr_pos	= src->vmap[i].pos;
+		dst->vmaps[i].pickup		= src->vmap[i].pickup;
+		dst->vmaps[i].lagging		= false;
 		dst->vmaps[i].rgb.red		= src->vmap[i].rgb_r;
 		dst->vmaps[i].rgb.green = src->vmap[i].rgb_g;
 		dst->vmaps[i].rgb.blue	= src->vmap[i].rgb_b;
 		dst->vmaps[i].rb.red		= src->vmap[i].rb_r;
 		dst->vmaps[i].rb.blue		= src->vmap[i].rb_b;
 		decode_proto_cfg(&src->vmap[i].cfg, &dst->vmaps[i].cfg);
+		mf_vmap_scale_update(&dst->vmaps[i]);
 	}
 
 	decode_proto_cfg(&src->sw_cfg, &dst->sw_cfg);
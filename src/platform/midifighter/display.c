@@ -7,6 +7,7 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 #include <math.h>
+#include <string.h>
 
 #include "platform/midifighter/midifighter.h"
 
@@ -16,7 +17,7 @@
 #include "event/io.h"
 #include "event/midi.h"
 
-#include "sys/time.h"
+#include "display/display.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
@@ -27,6 +28,9 @@
 #define CLEAR_RIGHT_INDICATORS (0xF80F) // Mask to clear mid and right-side leds
 #define MASK_PWM_INDICATORS		 (0xFBE0)
 
+// Interval between display refresh events
+#define DISPLAY_REFRESH_MS		 (1000 / MF_NUM_PWM_FRAMES)
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 typedef union {
@@ -51,31 +55,60 @@ typedef union {
 	u16 state;
 } encoder_led_s;
 
+// Everything that the frames of an encoder are generated from
+typedef struct {
+	u8			mode;
+	u8			detent;
+	u8			fine;
+	u8			pos;
+	rgb_8_s rgb;
+	rb_8_s	rb;
+} frame_key_s;
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool frame_changed(const mf_encoder_s* enc, u8 pos);
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+// Key of the frames currently in the frame buffer, per hardware encoder
+static frame_key_s drawn[MF_NUM_ENCODERS];
+
 static const u16 led_interval		= ENC_MAX / 11;
 static const u8	 max_brightness = MF_MAX_BRIGHTNESS;
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-void display_update(void) {
+int mf_display_init(void) {
+	// No key matches an invalid display mode, so the first draw always happens
+	memset(drawn, 0xFF, sizeof(drawn));
 
-	u32 time_now = systime_ms();
+	// Redraw at most once per refresh period rather than on every change
+	io_event_s refresh = {.type = EVT_IO_DISPLAY_REFRESH, .ctx = NULL};
+	return event_post_periodic(EVENT_CHANNEL_IO, &refresh, DISPLAY_REFRESH_MS,
+														 NULL);
+}
 
+void display_update(void) {
 	for (uint e = 0; e < MF_NUM_ENCODERS; e++) {
 		mf_encoder_s* enc = &gENCODERS[gRT.curr_bank][e];
 
-		if (enc->update_display != 0) {
-			if ((time_now - enc->update_display) > (1000 / MF_NUM_PWM_FRAMES)) {
-				mf_draw_encoder(enc);
-				enc->update_display = 0;
-			}
+		if (enc->update_display) {
+			mf_draw_encoder(enc);
+			enc->update_display = false;
 		}
 	}
 }
 
+int mf_display_refresh_handler(void* event) {
+	(void)event;
+
+	// Only registered for EVT_IO_DISPLAY_REFRESH, see event_table.c
+	display_update();
+	return 0;
+}
+
 int mf_draw_encoder(mf_encoder_s* enc) {
 	assert(enc);
 
@@ -84,7 +117,15 @@ int mf_draw_encoder(mf_encoder_s* enc) {
 	uint max_frames; // max frames to generate (for the correct brightness)
 	encoder_led_s leds = {0};
 
-	ind_pwm	 = ((f32)enc->vmaps[enc->vmap_active].curr_pos / led_interval);
+	// The LED ring only needs the integer part of the position
+	u8 pos = enc->vmaps[enc->vmap_active].curr_pos >> ENC_POS_FRAC_BITS;
+
+	// Regenerating the 32 frames is expensive, skip it if they would not change
+	if (!frame_changed(enc, pos)) {
+		return 0;
+	}
+
+	ind_pwm	 = ((f32)pos / led_interval);
 	ind_norm = (unsigned int)roundf(ind_pwm);
 
 	// Generate the LED states based on the display mode
@@ -206,6 +247,12 @@ int mf_draw_encoder(mf_encoder_s* enc) {
 			}
 		}
 
+		// Fine adjust is shown by both detent LEDs at full brightness
+		if (enc->fine) {
+			leds.detent_red	 = 1;
+			leds.detent_blue = 1;
+		}
+
 		// Write the LED state to the frame buffer
 		// As 0 = LED on, 1 = LED off we invert all the states before writing
 		gFRAME_BUFFER[f][enc->idx] = ~leds.state;
@@ -216,6 +263,31 @@ int mf_draw_encoder(mf_encoder_s* enc) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+// Update the key for the encoder slot, returns true if it differs
+static bool frame_changed(const mf_encoder_s* enc, u8 pos) {
+	const virtmap_s* vmap = &enc->vmaps[enc->vmap_active];
+	frame_key_s			 key;
+
+	memset(&key, 0, sizeof(key));
+	key.mode	 = (u8)enc->display.mode;
+	key.detent = enc->detent;
+	key.fine	 = enc->fine;
+	key.pos		 = pos;
+	key.rgb		 = vmap->rgb;
+
+	// The detent LEDs are only drawn in detent mode
+	if (enc->detent) {
+		key.rb = vmap->rb;
+	}
+
+	if (memcmp(&key, &drawn[enc->idx], sizeof(key)) == 0) {
+		return false;
+	}
+
+	drawn[enc->idx] = key;
+	return true;
+}
+
 /*
 
 static void display_update(input_dev_encoder_s* dev) {
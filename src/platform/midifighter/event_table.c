@@ -0,0 +1,58 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+ * Event channels and handlers for the midifighter.
+ * All tables are constant and stored in flash. The handlers for each channel
+ * are called in table order, so each table must be kept in priority order.
+ */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "event/event.h"
+#include "event/sys.h"
+#include "event/io.h"
+#include "event/midi.h"
+#include "protocol/midi/midi.h"
+#include "platform/midifighter/midifighter.h"
+#include "platform/midifighter/sysex.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+FLASH static const event_ch_handler_s sys_handlers[] = {
+		EVT_HANDLER(EVT_TYPE(EVT_SYS_REQ_CFG_SAVE), mf_cfg_sys_handler),
+};
+
+FLASH static const event_ch_handler_s io_handlers[] = {
+		EVT_HANDLER(EVT_TYPE(EVT_IO_DISPLAY_REFRESH), mf_display_refresh_handler),
+		EVT_HANDLER(EVT_TYPE(EVT_IO_ENCODER_SWITCH), mf_input_gesture_handler),
+};
+
+FLASH static const event_ch_handler_s midi_in_handlers[] = {
+		EVT_HANDLER(EVT_TYPE(MIDI_EVENT_CC), mf_input_midi_handler),
+		EVT_HANDLER(EVT_TYPE(MIDI_EVENT_SYSEX), mf_sysex_midi_handler),
+};
+
+FLASH static const event_ch_handler_s midi_out_handlers[] = {
+		EVT_HANDLER(EVT_TYPES_ALL, midi_out_handler),
+};
+
+FLASH const event_ch_def_s gEVENT_CHANNELS[EVENT_CHANNEL_NB] = {
+		[EVENT_CHANNEL_SYS]			 = EVT_CHANNEL(&sys_event_ch, sys_handlers),
+		[EVENT_CHANNEL_IO]			 = EVT_CHANNEL(&io_event_ch, io_handlers),
+		[EVENT_CHANNEL_MIDI_IN]	 = EVT_CHANNEL(&midi_in_event_ch, midi_in_handlers),
+		[EVENT_CHANNEL_MIDI_OUT] =
+				EVT_CHANNEL(&midi_out_event_ch, midi_out_handlers),
+};
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
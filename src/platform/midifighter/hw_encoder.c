@@ -5,13 +5,20 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
 #include "sys/error.h"
 #include "sys/types.h"
 #include "sys/utility.h"
+#include "hal/avr/xmega/128a4u/dma.h"
 #include "hal/avr/xmega/128a4u/gpio.h"
+#include "hal/avr/xmega/128a4u/usart.h"
 #include "input/quadrature.h"
 #include "input/switch.h"
 #include "lfo/lfo.h"
+#include "trace/trace.h"
 
 #include "platform/midifighter/midifighter.h"
 
@@ -23,76 +30,194 @@
 #define PIN_SR_ENC_CLOCK	 (1)
 #define PIN_SR_ENC_DATA_IN (2)
 
+#define USART_SR_ENC			 (USARTC0) // USART (SPI) on C0
+#define USART_BAUD				 (4000000)
+#define DMA_SR_ENC_RX			 (DMA.CH2) // USART rx -> sr_data
+#define DMA_SR_ENC_TX			 (DMA.CH3) // Dummy bytes -> USART tx (clock)
+
+#define TIMER_ENC_SCAN		 (TCC0) // Timer for the encoder scan ISR
+#define ENC_SCAN_PERIOD		 ((F_CPU + (MF_ENC_SCAN_HZ / 2)) / MF_ENC_SCAN_HZ)
+STATIC_ASSERT(ENC_SCAN_PERIOD <= 0x10000, "MF_ENC_SCAN_HZ is too low");
+
+// The switches are debounced on every Nth scan, a 1 ms sample period like the
+// side switches (debounce time = SWITCH_DEBOUNCE_DEPTH ms)
+#define ENC_SW_DIVIDER		 (MF_ENC_SCAN_HZ / 1000)
+STATIC_ASSERT(ENC_SW_DIVIDER >= 1, "MF_ENC_SCAN_HZ is too low");
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 quadrature_s gQUAD_ENC[MF_NUM_ENCODERS];
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void sample(void);
+static void decode(void);
+static u8		unzip(u8 data);
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 static switch_x16_ctx_s switch_ctx;
+static quadrature_x16_s quad_ctx;
+
+// Switch edges debounced by the scan ISR since the last hw_encoder_update()
+static volatile u16 sw_acc_pressed	= 0;
+static volatile u16 sw_acc_released = 0;
+
+// Switch edges reported to the main loop by the last hw_encoder_update()
+static u16 sw_pressed	 = 0;
+static u16 sw_released = 0;
+
+// Encoders that reached a detent since the last hw_encoder_moved() call
+static volatile u16 moved = 0;
+
+// Raw shift register levels, in clock order (first bit = bit 0 of byte 0).
+// Bytes 0-1 hold the encoder switches, bytes 2-5 hold the quadrature signals
+// as A/B pairs, 4 encoders per byte.
+static vu8 sr_data[MF_NUM_INPUT_SHIFT_REGISTERS];
+
+#ifndef MF_ENC_SCAN_GPIO
+// Transmitted to generate the SPI clock, the data out pin is not connected
+static u8 sr_dummy = 0xFF;
+#endif
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void hw_encoder_init(void) {
+	for (uint i = 0; i < MF_NUM_ENCODERS; i++) {
+		gQUAD_ENC[i].dir	 = 0;
+		gQUAD_ENC[i].rot	 = 0;
+		gQUAD_ENC[i].steps = 0;
+		gQUAD_ENC[i].read	 = 0;
+	}
+
+	switch_x16_init(&switch_ctx, SWITCH_DEBOUNCE_DEPTH);
+
+	quad_ctx.half = 0;
+	quad_ctx.cw		= 0;
+	quad_ctx.ccw	= 0;
+
 	// Configure GPIO for encoder IO shift regsiters
 	gpio_dir(&PORT_SR_ENC, PIN_SR_ENC_LATCH, GPIO_OUTPUT);
+
+#ifdef MF_ENC_SCAN_GPIO
 	gpio_dir(&PORT_SR_ENC, PIN_SR_ENC_CLOCK, GPIO_OUTPUT);
 	gpio_dir(&PORT_SR_ENC, PIN_SR_ENC_DATA_IN, GPIO_INPUT);
+#else
+	// Configure USART (SPI) for the encoder shift registers. The registers
+	// shift on the rising edge, so idle the clock high and sample on the
+	// falling edge (the same timing as the bit-banged scan).
+	usart_config_s usart_cfg = {
+			.baudrate = USART_BAUD,
+			.endian		= ENDIAN_LSB,
+			.mode			= SPI_MODE_CLK_HI_PHA_LO,
+	};
+
+	// Configure DMA to copy each received byte into sr_data, a transfer is
+	// 6 bytes (block count) x 1 times (repeat count).
+	// The trigger is set to USART receive complete.
+	dma_channel_cfg_s dma_rx_cfg = {
+			.repeat_count		 = 1,
+			.block_size			 = MF_NUM_INPUT_SHIFT_REGISTERS,
+			.burst_len			 = DMA_CH_BURSTLEN_1BYTE_gc,
+			.trig_source		 = DMA_CH_TRIGSRC_USARTC0_RXC_gc, // usart rx complete
+			.dbuf_mode			 = DMA_DBUFMODE_DISABLED_gc,
+			.int_prio				 = PRIORITY_OFF,
+			.err_prio				 = PRIORITY_OFF,
+			.src_ptr				 = (uptr)&USART_SR_ENC.DATA,
+			.src_addr_mode	 = DMA_CH_SRCDIR_FIXED_gc,
+			.src_reload_mode = DMA_CH_SRCRELOAD_NONE_gc,
+			.dst_ptr				 = (uptr)&sr_data[0],
+			.dst_addr_mode	 = DMA_CH_DESTDIR_INC_gc,
+			.dst_reload_mode = DMA_CH_DESTRELOAD_BLOCK_gc,
+	};
+
+	// Configure DMA to write a dummy byte for every byte to be received.
+	// The trigger is set to USART data buffer being empty.
+	dma_channel_cfg_s dma_tx_cfg = {
+			.repeat_count		 = 1,
+			.block_size			 = MF_NUM_INPUT_SHIFT_REGISTERS,
+			.burst_len			 = DMA_CH_BURSTLEN_1BYTE_gc,
+			.trig_source		 = DMA_CH_TRIGSRC_USARTC0_DRE_gc, // empty usart buffer
+			.dbuf_mode			 = DMA_DBUFMODE_DISABLED_gc,
+			.int_prio				 = PRIORITY_OFF,
+			.err_prio				 = PRIORITY_OFF,
+			.src_ptr				 = (uptr)&sr_dummy,
+			.src_addr_mode	 = DMA_CH_SRCDIR_FIXED_gc,
+			.src_reload_mode = DMA_CH_SRCRELOAD_NONE_gc,
+			.dst_ptr				 = (uptr)&USART_SR_ENC.DATA,
+			.dst_addr_mode	 = DMA_CH_DESTDIR_FIXED_gc,
+			.dst_reload_mode = DMA_CH_DESTRELOAD_NONE_gc,
+	};
+#endif
 
 	// Latch initial encoder data
 	gpio_set(&PORT_SR_ENC, PIN_SR_ENC_LATCH, 0);
 	gpio_set(&PORT_SR_ENC, PIN_SR_ENC_LATCH, 1);
 
-	for (uint i = 0; i < MF_NUM_ENCODERS; i++) {
-		gQUAD_ENC[i].dir = 0;
-		gQUAD_ENC[i].rot = 0;
-	}
+#ifndef MF_ENC_SCAN_GPIO
+	// The first transfer starts as soon as the USART is enabled, so the first
+	// scan ISR has valid data to decode.
+	dma_channel_init(&DMA_SR_ENC_RX, &dma_rx_cfg);
+	dma_channel_init(&DMA_SR_ENC_TX, &dma_tx_cfg);
+	usart_module_init(&USART_SR_ENC, &usart_cfg);
+#endif
+
+	// Start the scan timer, the ISR runs at the lowest priority so that it
+	// never delays the LED refresh.
+	TIMER_ENC_SCAN.PER			= ENC_SCAN_PERIOD - 1;
+	TIMER_ENC_SCAN.CTRLB		= TC_WGMODE_NORMAL_gc;
+	TIMER_ENC_SCAN.INTCTRLA = TC_OVFINTLVL_LO_gc;
+	TIMER_ENC_SCAN.CNT			= 0;
+	TIMER_ENC_SCAN.CTRLA		= TC_CLKSEL_DIV1_gc;
 }
 
-// Scan the hardware state of the midifighter and update local contexts
-void hw_encoder_scan(void) {
-	// Latch the IO levels into the shift registers
-	gpio_set(&PORT_SR_ENC, PIN_SR_ENC_LATCH, 1);
+void hw_encoder_update(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		const u16 pressed	 = sw_acc_pressed;
+		const u16 released = sw_acc_released;
 
-	// Clock the 16 data bits for the encoder switches
-	u16 swstates = 0;
-	for (size_t i = 0; i < MF_NUM_ENCODER_SWITCHES; i++) {
-		gpio_set(&PORT_SR_ENC, PIN_SR_ENC_CLOCK, 0);
-		u8 state = !(bool)gpio_get(&PORT_SR_ENC, PIN_SR_ENC_DATA_IN);
-		gpio_set(&PORT_SR_ENC, PIN_SR_ENC_CLOCK, 1);
-		swstates |= (state << i);
-	}
+		// A switch that was pressed and released (or the reverse) since the last
+		// pass reports its first edge now and the second on the next pass, the
+		// debounced state tells which edge came last.
+		const u16 both		 = pressed & released;
+		const u16 late_on	 = both & switch_ctx.current;
+		const u16 late_off = both & (u16)~switch_ctx.current;
 
-	// Execute the debounce and update routine for the switches
-	switch_x16_update(&switch_ctx, swstates);
+		sw_pressed			= pressed & (u16)~late_on;
+		sw_released			= released & (u16)~late_off;
+		sw_acc_pressed	= late_on;
+		sw_acc_released = late_off;
+	}
+}
 
-	// Clock the 32 bits for the 2x16 quadrature encoder signals, and update
-	// encoder state.
-	for (int i = 0; i < MF_NUM_ENCODERS; ++i) {
-		gpio_set(&PORT_SR_ENC, PIN_SR_ENC_CLOCK, 0);
-		u8 ch_a = (bool)gpio_get(&PORT_SR_ENC, PIN_SR_ENC_DATA_IN);
-		gpio_set(&PORT_SR_ENC, PIN_SR_ENC_CLOCK, 1);
-		gpio_set(&PORT_SR_ENC, PIN_SR_ENC_CLOCK, 0);
-		u8 ch_b = (bool)gpio_get(&PORT_SR_ENC, PIN_SR_ENC_DATA_IN);
-		gpio_set(&PORT_SR_ENC, PIN_SR_ENC_CLOCK, 1);
+u16 hw_encoder_moved(void) {
+	u16 mask;
 
-		quadrature_update(&gQUAD_ENC[i], ch_a, ch_b);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		mask	= moved;
+		moved = 0;
 	}
 
-	// Close the door!
-	gpio_set(&PORT_SR_ENC, PIN_SR_ENC_LATCH, 0);
+	return mask;
+}
+
+u16 hw_enc_switch_pressed(void) {
+	return sw_pressed;
+}
+
+u16 hw_enc_switch_released(void) {
+	return sw_released;
 }
 
 switch_state_e hw_enc_switch_state(u8 idx) {
 	assert(idx < MF_NUM_ENCODER_SWITCHES);
 
-	if (switch_was_pressed(&switch_ctx, idx)) {
+	if (sw_pressed & (1u << idx)) {
 		return SWITCH_PRESSED;
 	}
 
-	if (switch_was_released(&switch_ctx, idx)) {
+	if (sw_released & (1u << idx)) {
 		return SWITCH_RELEASED;
 	}
 
@@ -100,3 +225,102 @@ switch_state_e hw_enc_switch_state(u8 idx) {
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+ISR(TCC0_OVF_vect) {
+#ifdef MF_ENC_SCAN_GPIO
+	sample();
+	decode();
+#else
+	// The previous transfer completed long ago (48 bits at USART_BAUD), decode
+	// it and then start the next one.
+	decode();
+	sample();
+#endif
+}
+
+#ifdef MF_ENC_SCAN_GPIO
+
+// Bit-bang the shift registers into sr_data
+static void sample(void) {
+	// Latch the IO levels into the shift registers
+	gpio_set(&PORT_SR_ENC, PIN_SR_ENC_LATCH, 1);
+
+	for (uint i = 0; i < MF_NUM_INPUT_SHIFT_REGISTERS; i++) {
+		u8 data = 0;
+		for (uint bit = 0; bit < 8; bit++) {
+			gpio_set(&PORT_SR_ENC, PIN_SR_ENC_CLOCK, 0);
+			data |= (u8)((bool)gpio_get(&PORT_SR_ENC, PIN_SR_ENC_DATA_IN) << bit);
+			gpio_set(&PORT_SR_ENC, PIN_SR_ENC_CLOCK, 1);
+		}
+		sr_data[i] = data;
+	}
+
+	// Close the door!
+	gpio_set(&PORT_SR_ENC, PIN_SR_ENC_LATCH, 0);
+}
+
+#else
+
+// Latch the shift registers and start a DMA transfer into sr_data
+static void sample(void) {
+	gpio_set(&PORT_SR_ENC, PIN_SR_ENC_LATCH, 0);
+	gpio_set(&PORT_SR_ENC, PIN_SR_ENC_LATCH, 1);
+
+	// Enable rx first so that no received byte is missed
+	DMA_SR_ENC_RX.CTRLA |= DMA_CH_ENABLE_bm;
+	DMA_SR_ENC_TX.CTRLA |= DMA_CH_ENABLE_bm;
+}
+
+#endif
+
+// Decode sr_data and update the switch and encoder contexts
+static void decode(void) {
+	static u8 sw_div = 0;
+
+	// Debounce each switch sample exactly once, switches are active low
+	if (++sw_div >= ENC_SW_DIVIDER) {
+		sw_div = 0;
+		switch_x16_update(&switch_ctx, (u16)~(sr_data[0] | (sr_data[1] << 8)));
+		sw_acc_pressed |= switch_x16_pressed(&switch_ctx);
+		sw_acc_released |= switch_x16_released(&switch_ctx);
+	}
+
+	// Split the A/B pairs into one word per channel
+	u16 ch_a = 0;
+	u16 ch_b = 0;
+	for (uint i = 0; i < 4; i++) {
+		ch_a |= (u16)(unzip(sr_data[2 + i]) << (i * 4));
+		ch_b |= (u16)(unzip(sr_data[2 + i] >> 1) << (i * 4));
+	}
+
+	u16 cw, ccw;
+	quadrature_x16_update(&quad_ctx, ch_a, ch_b, &cw, &ccw);
+
+	if ((cw | ccw) == 0) {
+		return;
+	}
+
+	moved |= cw | ccw;
+
+	for (uint i = 0; i < MF_NUM_ENCODERS; ++i) {
+		const u16 mask = (u16)(1u << i);
+		if (cw & mask) {
+			gQUAD_ENC[i].steps++;
+		} else if (ccw & mask) {
+			gQUAD_ENC[i].steps--;
+		} else {
+			continue;
+		}
+
+		// A detent has been reached, start a latency trace
+		TRACE_START((u8)i);
+	}
+}
+
+// Gather the even bits of data into the low nibble
+static u8 unzip(u8 data) {
+	data &= 0x55;
+	data = (data | (data >> 1)) & 0x33;
+	data = (data | (data >> 2)) & 0x0F;
+	return data;
+}
@@ -7,18 +7,27 @@
 
 #include <avr/io.h>
 
+#include "sys/time.h"
 #include "hal/avr/xmega/128a4u/gpio.h"
+#include "input/switch.h"
 
 #include "platform/midifighter/midifighter.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-#define PORT_SW (PORTA) // IO port for side-switches
+#define PORT_SW			 (PORTA) // IO port for side-switches
+#define PORT_SW_MASK (0x3F)	 // Side-switches are on pins 0 to 5
+#define SW_SCAN_MS	 (1)		 // Sample period, sets the debounce time
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static switch_x8_ctx_s switch_ctx;
+static u32						 last_scan;
+static bool						 scanned; // Edges are only valid on a scan pass
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void hw_switch_init(void) {
@@ -27,10 +36,37 @@ void hw_switch_init(void) {
 		gpio_dir(&PORT_SW, i, GPIO_INPUT);
 		gpio_mode(&PORT_SW, i, PORT_OPC_PULLUP_gc);
 	}
+
+	switch_x8_init(&switch_ctx, SWITCH_DEBOUNCE_DEPTH);
+	last_scan = systime_ms();
 }
 
 void hw_switch_update(void) {
-	// switch_x8_update
+	u32 now = systime_ms();
+
+	/*
+		The main loop runs far faster than a switch bounces, so the pins are
+		sampled at a fixed rate to give the debounce a known duration
+		(SWITCH_DEBOUNCE_DEPTH * SW_SCAN_MS). No edges are reported on the
+		passes in between so that a press is only seen once.
+	*/
+	scanned = (now - last_scan >= SW_SCAN_MS);
+	if (!scanned) {
+		return;
+	}
+
+	last_scan = now;
+
+	// Switches are active low (pulled up)
+	switch_x8_update(&switch_ctx, (u8)(~PORT_SW.IN & PORT_SW_MASK));
+}
+
+u8 hw_switch_pressed(void) {
+	return scanned ? switch_x8_pressed(&switch_ctx) : 0;
+}
+
+u8 hw_switch_released(void) {
+	return scanned ? switch_x8_released(&switch_ctx) : 0;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -13,10 +13,12 @@
 #include "sys/print.h"
 #include "sys/time.h"
 #include "input/encoder.h"
+#include "input/gesture.h"
 #include "event/event.h"
 #include "event/io.h"
 #include "event/midi.h"
 #include "event/sys.h"
+#include "trace/trace.h"
 
 #include "platform/midifighter/midifighter.h"
 
@@ -27,30 +29,146 @@
 
 static void sw_encoder_init(void);
 static void sw_encoder_update(void);
-static void vmap_update(mf_encoder_s* enc, virtmap_s* map);
-static int	midi_in_handler(void* evt);
+static void sw_update(mf_encoder_s* enc);
+static void side_switch_update(void);
+static void bank_feedback(u8 bank);
+static void fine_adjust(mf_encoder_s* enc, bool fine);
+static void hold_release(mf_encoder_s* enc);
+static bool vmap_update(mf_encoder_s* enc, virtmap_s* map);
+static void rel_update(virtmap_s* vmap, i16 velocity);
+static bool is_relative(const virtmap_s* vmap);
+static bool pickup_update(virtmap_s* vmap, i16 velocity, i32* newpos);
+static bool feedback_echo(virtmap_s* vmap, u8 value);
+static u8		rel_encode(u8 mode, i8 delta);
+static void note_update(mf_encoder_s* enc, virtmap_s* vmap, i16 val);
+static void sw_gate(mf_encoder_s* enc, bool on);
+static bool gate_on(mf_encoder_s* enc, u8 idx, u8 channel, u8 note, u8 value,
+										bool cc);
+static bool gate_off(mf_encoder_s* enc, u8 idx);
+static void gates_update(void);
+static void notes_off(u8 bank);
+static bool send_note(u8 channel, u8 note, u8 velocity);
+static bool send_cc(u8 channel, u8 control, u8 value);
+static u16	vmap_start(const virtmap_s* vmap);
+static u16	vmap_stop(const virtmap_s* vmap);
+static i16	vmap_value(const virtmap_s* vmap, i16 lower, i16 upper);
+static u16	vmap_position(const virtmap_s* vmap, i8 value);
+static u16	span(i32 a, i32 b);
+static i16	cc14(i8 val);
 static void print_dir(uint enc_idx, int dir);
 static void rgb_init(void);
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-EVT_HANDLER(1, evt_midi, midi_in_handler);
-
 mf_encoder_s gENCODERS[MF_NUM_ENC_BANKS][MF_NUM_ENCODERS];
 
+static gesture_x16_ctx_s gestures;
+
+// Set when a gate off is waiting for space in the midi queue
+static bool gates_pending = false;
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void mf_input_init(void) {
 	hw_encoder_init();
 	hw_switch_init();
 	sw_encoder_init();
-	event_channel_subscribe(EVENT_CHANNEL_MIDI_IN, &evt_midi);
+
+	gesture_cfg_s cfg = {
+			.long_ms	 = gCONFIG.gesture_long_time,
+			.double_ms = gCONFIG.gesture_double_time,
+	};
+	gesture_x16_init(&gestures, EVT_IO_ENCODER_SWITCH, &cfg);
+}
+
+void mf_gesture_cfg_update(void) {
+	gesture_cfg_s cfg = {
+			.long_ms	 = gCONFIG.gesture_long_time,
+			.double_ms = gCONFIG.gesture_double_time,
+	};
+	gesture_x16_set_cfg(&gestures, &cfg);
 }
 
 void mf_input_update(void) {
-	hw_encoder_scan();
+	hw_encoder_update();
+	hw_switch_update();
+	side_switch_update();
 	sw_encoder_update();
+	gates_update();
+}
+
+int mf_bank_select(u8 bank) {
+	if (bank >= MF_NUM_ENC_BANKS) {
+		return ERR_BAD_PARAM;
+	} else if (bank == gRT.curr_bank) {
+		return 0;
+	}
+
+	// The controls of the old bank can not release its notes any more
+	notes_off(gRT.curr_bank);
+
+	// Movement does not carry over, the old bank must accept incoming values.
+	// Neither do holds, the release would be handled by the new bank.
+	for (uint e = 0; e < MF_NUM_ENCODERS; e++) {
+		mf_encoder_s* enc			= &gENCODERS[gRT.curr_bank][e];
+		enc->enc_ctx.velocity = 0;
+		hold_release(enc);
+	}
+
+	gRT.curr_bank = bank;
+
+	/*
+		Nothing is sent for the new bank, its values are already known to the
+		host. The display is only flagged here, the redraw happens on the next
+		refresh and mf_draw_encoder() skips encoders that look the same in both
+		banks, so the LED frame buffer is not rewritten in one burst.
+	*/
+	for (uint e = 0; e < MF_NUM_ENCODERS; e++) {
+		gENCODERS[bank][e].update_display = true;
+	}
+
+	if (gRT.bank_feedback) {
+		bank_feedback(bank);
+	}
+
+	return 0;
+}
+
+void mf_notes_off(void) {
+	for (u8 b = 0; b < MF_NUM_ENC_BANKS; b++) {
+		notes_off(b);
+	}
+}
+
+void mf_gate_release(mf_encoder_s* enc, u8 gate) {
+	assert(enc);
+	assert(gate < MF_NUM_GATES_PER_ENC);
+
+	gate_off(enc, gate);
+}
+
+void mf_vmap_scale_update(virtmap_s* vmap) {
+	assert(vmap);
+
+	const u16 start = vmap_start(vmap);
+	const u16 stop	= vmap_stop(vmap);
+	const u16 pos		= (stop > start) ? stop - start : 0;
+	const u16 val		= span(vmap->range.lower, vmap->range.upper);
+
+	// Outgoing values use the full 14 bits, incoming feedback is always 7 bits
+	if (vmap->cfg.type == PROTOCOL_MIDI &&
+			vmap->cfg.midi.mode == MIDI_MODE_CC_14) {
+		scale_init(&vmap->to_val,
+							 span(cc14(vmap->range.lower), cc14(vmap->range.upper)), pos);
+	} else {
+		scale_init(&vmap->to_val, val, pos);
+	}
+
+	scale_init(&vmap->to_pos, pos, val);
+
+	// Pending relative movement was counted with the old scale
+	vmap->rel_acc = 0;
 }
 
 bool mf_is_reset_pressed(void) {
@@ -58,6 +176,96 @@ bool mf_is_reset_pressed(void) {
 				 hw_enc_switch_state(3) == SWITCH_PRESSED;
 }
 
+int mf_input_midi_handler(void* evt) {
+	midi_event_s* midi = (midi_event_s*)evt;
+
+	switch (midi->type) {
+		case MIDI_EVENT_CC: {
+			// Only the vmaps mapped to this channel and CC, see vmap_index.c
+			u8 first;
+			u8 count = mf_vmap_index_find(midi->data.cc.channel,
+																		midi->data.cc.control, &first);
+
+			for (u8 i = first; i < first + count; i++) {
+				u8						v;
+				mf_encoder_s* enc	 = mf_vmap_index_get(i, &v);
+				virtmap_s*		vmap = &enc->vmaps[v];
+
+				// do not update if the encoder is moving.
+				if (enc->enc_ctx.velocity != 0) {
+					continue;
+				}
+
+				// The host repeating what was sent is not a new value
+				if (feedback_echo(vmap, midi->data.cc.value)) {
+					continue;
+				}
+
+				u16 pos = vmap_position(vmap, (i8)midi->data.cc.value);
+
+				// The controller stays behind, at the old value if it was in control
+				if (vmap->pickup != VIRTMAP_PICKUP_JUMP && !is_relative(vmap)) {
+					if (!vmap->lagging) {
+						vmap->ctrl_pos = vmap->curr_pos;
+					}
+
+					// Within one value of each other they are still in step
+					vmap->lagging =
+							span(pos, vmap->ctrl_pos) > scale_apply(&vmap->to_pos, 1);
+				}
+
+				vmap->curr_pos			= pos;
+				enc->update_display = true;
+			}
+
+			break;
+		}
+	}
+
+	return 0;
+}
+
+int mf_input_gesture_handler(void* evt) {
+	io_event_s*		io	= (io_event_s*)evt;
+	mf_encoder_s* enc = &gENCODERS[gRT.curr_bank][io->sw.idx];
+
+	switch (enc->sw_mode) {
+		case SW_MODE_VMAP_HOLD: {
+			// The alternative mapping is only active while the switch is held
+			if (io->sw.gesture == GESTURE_PRESS) {
+				enc->vmap_active = 1 % MF_NUM_VMAPS_PER_ENC;
+			} else if (io->sw.gesture == GESTURE_RELEASE) {
+				enc->vmap_active = 0;
+			} else {
+				break;
+			}
+
+			enc->update_display = true;
+			break;
+		}
+
+		case SW_MODE_FINE_ADJUST_TOGGLE: {
+			if (io->sw.gesture == GESTURE_PRESS) {
+				fine_adjust(enc, !enc->fine);
+			}
+			break;
+		}
+
+		case SW_MODE_FINE_ADJUST_HOLD: {
+			if (io->sw.gesture == GESTURE_PRESS) {
+				fine_adjust(enc, true);
+			} else if (io->sw.gesture == GESTURE_RELEASE) {
+				fine_adjust(enc, false);
+			}
+			break;
+		}
+
+		default: break;
+	}
+
+	return 0;
+}
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 static void sw_encoder_init(void) {
@@ -76,6 +284,9 @@ static void sw_encoder_init(void) {
 			enc->vmap_active			= 0;
 			enc->sw_mode					= SW_MODE_VMAP_CYCLE;
 			enc->sw_state					= SWITCH_IDLE;
+			enc->update_display		= true; // Draw every encoder once at startup
+			enc->fine							= false;
+			enc->fine_div					= ENC_FINE_DIV;
 
 			// Defaults
 			// Row 1 (idx = 0,1,2,3) = pan encoder (detent true) (rgb = light blue)
@@ -104,6 +315,7 @@ static void sw_encoder_init(void) {
 				map->cfg.type					= PROTOCOL_MIDI;
 				map->cfg.midi.channel = 0;
 				map->cfg.midi.cc			= cc++;
+				map->pickup						= VIRTMAP_PICKUP_JUMP;
 
 				// Assign RGB based on encoder index
 				if (enc->idx < 4) {
@@ -129,7 +341,7 @@ static void sw_encoder_init(void) {
 				map->rgb.blue	 = (map->rgb.blue + 12) * v % MF_RGB_MAX_VAL;
 
 				if (enc->detent) {
-					map->curr_pos = ENC_MID;
+					map->curr_pos = ENC_POS(ENC_MID);
 					// Assign RB based on encoder index
 					if (enc->idx < 4) {
 						map->rb.red	 = 0x1F;
@@ -145,127 +357,223 @@ static void sw_encoder_init(void) {
 						map->rb.blue = 0x1F;
 					}
 				}
+
+				mf_vmap_scale_update(map);
 			}
 		}
 	}
+
+	mf_vmap_index_init();
 }
 
 static void sw_encoder_update(void) {
-	for (uint i = 0; i < MF_NUM_ENCODERS; i++) {
-		mf_encoder_s* enc = &gENCODERS[gRT.curr_bank][i];
-
-		enc->sw_state = hw_enc_switch_state(enc->idx);
+	// Encoders still reporting a velocity need one more (zero) update
+	static u16 active = 0;
+
+	// Timestamp for the gesture and acceleration timing
+	const u16 now				 = (u16)systime_ms();
+	const u16 pressed		 = hw_enc_switch_pressed();
+	const u16 released	 = hw_enc_switch_released();
+	const u16 sw_changed = pressed | released;
+	const u16 turned		 = hw_encoder_moved();
+	const u16 moved			 = turned | active;
+
+	// Gestures are posted as io events, handled by mf_input_gesture_handler()
+	gesture_x16_update(&gestures, pressed, released, turned, now);
+
+	// Only visit the encoders that have something to do, in the common case
+	// no bits are set and this returns straight away.
+	u16 pending = sw_changed | moved;
+	if (pending == 0) {
+		return;
+	}
 
-		if (enc->sw_state == SWITCH_PRESSED) {
-			switch (enc->sw_mode) {
-				case SW_MODE_NONE: {
-					break;
-				}
+	for (uint i = 0; pending != 0; i++, pending >>= 1) {
+		if ((pending & 0x01) == 0) {
+			continue;
+		}
 
-				case SW_MODE_VMAP_CYCLE: {
-					enc->vmap_active = (enc->vmap_active + 1) % MF_NUM_VMAPS_PER_ENC;
-					mf_draw_encoder(enc);
-					break;
-				}
+		mf_encoder_s* enc	 = &gENCODERS[gRT.curr_bank][i];
+		const u16			mask = (u16)(1u << i);
 
-				case SW_MODE_VMAP_HOLD: {
-					// ?
-					break;
-				}
+		if (sw_changed & mask) {
+			sw_update(enc);
+		}
 
-				case SW_MODE_RESET_ON_PRESS: {
-					enc->vmaps[enc->vmap_active].curr_pos = 0;
-					break;
-				}
+		if ((moved & mask) == 0) {
+			continue;
+		}
 
-				case SW_MODE_RESET_ON_RELEASE: {
-					break;
-				}
+		// Detents are counted by the scan ISR, consume them all at once
+		int	 steps	 = quadrature_steps(enc->quad_ctx);
+		bool changed = false;
+		encoder_update(&enc->enc_ctx, steps, now);
 
-				case SW_MODE_FINE_ADJUST_TOGGLE: {
-					break;
-				}
+		if (enc->enc_ctx.velocity != 0) {
+			active |= mask;
+		} else {
+			active &= (u16)~mask;
+		}
 
-				case SW_MODE_FINE_ADJUST_HOLD: {
-					break;
-				}
+		// Events posted for this encoder continue its latency trace
+		TRACE_INPUT((u8)i);
 
-				default: break;
+		if (enc->vmap_mode == VIRTMAP_MODE_TOGGLE) {
+			changed = vmap_update(enc, &enc->vmaps[enc->vmap_active]);
+		} else {
+			for (uint v = 0; v < MF_NUM_VMAPS_PER_ENC; v++) {
+				changed |= vmap_update(enc, &enc->vmaps[v]);
 			}
+		}
 
-			enc->sw_state = SWITCH_IDLE;
-		} else if (enc->sw_state == SWITCH_RELEASED) {
-			switch (enc->sw_mode) {
-				case SW_MODE_NONE: {
-					break;
-				}
+		TRACE_INPUT(TRACE_INPUT_NONE);
 
-				case SW_MODE_VMAP_CYCLE: {
-					break;
-				}
+		// Redrawn on the next display refresh
+		if (changed) {
+			enc->update_display = true;
+		}
+	}
+}
 
-				case SW_MODE_VMAP_HOLD: {
-					// ?
-					break;
-				}
+static void sw_update(mf_encoder_s* enc) {
+	enc->sw_state = hw_enc_switch_state(enc->idx);
 
-				case SW_MODE_RESET_ON_PRESS: {
-					break;
-				}
+	if (enc->sw_state == SWITCH_PRESSED) {
+		switch (enc->sw_mode) {
+			case SW_MODE_NONE: {
+				break;
+			}
 
-				case SW_MODE_RESET_ON_RELEASE: {
-					enc->vmaps[enc->vmap_active].curr_pos = 0;
-					break;
-				}
+			case SW_MODE_VMAP_CYCLE: {
+				enc->vmap_active = (enc->vmap_active + 1) % MF_NUM_VMAPS_PER_ENC;
+				mf_draw_encoder(enc);
+				break;
+			}
 
-				case SW_MODE_FINE_ADJUST_TOGGLE: {
-					break;
-				}
+			case SW_MODE_RESET_ON_PRESS: {
+				enc->vmaps[enc->vmap_active].curr_pos = 0;
+				enc->update_display										= true;
+				break;
+			}
 
-				case SW_MODE_FINE_ADJUST_HOLD: {
-					break;
-				}
+			case SW_MODE_RESET_ON_RELEASE: {
+				break;
+			}
 
-				default: break;
+			case SW_MODE_MIDI: {
+				sw_gate(enc, true);
+				break;
 			}
-			enc->sw_state = SWITCH_IDLE;
+
+			default: break;
 		}
 
-		int dir = quadrature_direction(enc->quad_ctx);
-		encoder_update(&enc->enc_ctx, dir);
+		enc->sw_state = SWITCH_IDLE;
+	} else if (enc->sw_state == SWITCH_RELEASED) {
+		switch (enc->sw_mode) {
+			case SW_MODE_NONE: {
+				break;
+			}
 
-		if (enc->vmap_mode == VIRTMAP_MODE_TOGGLE) {
-			vmap_update(enc, &enc->vmaps[enc->vmap_active]);
-		} else {
-			for (uint v = 0; v < MF_NUM_VMAPS_PER_ENC; v++) {
-				vmap_update(enc, &enc->vmaps[v]);
+			case SW_MODE_VMAP_CYCLE: {
+				break;
+			}
+
+			case SW_MODE_RESET_ON_PRESS: {
+				break;
+			}
+
+			case SW_MODE_RESET_ON_RELEASE: {
+				enc->vmaps[enc->vmap_active].curr_pos = 0;
+				enc->update_display										= true;
+				break;
+			}
+
+			case SW_MODE_MIDI: {
+				sw_gate(enc, false);
+				break;
 			}
+
+			default: break;
+		}
+		enc->sw_state = SWITCH_IDLE;
+	}
+}
+
+static void side_switch_update(void) {
+	u8 pressed = hw_switch_pressed();
+
+	for (u8 i = 0; pressed != 0; i++, pressed >>= 1) {
+		if ((pressed & 0x01) == 0) {
+			continue;
 		}
 
-		/*
-			At this point the encoder was moved, and we have calculated a new
-			position, and values for each of its virtual mappings. Now we need
-			to update the display.
-			The
-		*/
+		const mf_side_switch_s* sw = &gRT.side_sw[i];
+		switch (sw->mode) {
+			case SIDE_SW_MODE_BANK_PREV: {
+				mf_bank_select((gRT.curr_bank + MF_NUM_ENC_BANKS - 1) %
+											 MF_NUM_ENC_BANKS);
+				break;
+			}
+
+			case SIDE_SW_MODE_BANK_NEXT: {
+				mf_bank_select((gRT.curr_bank + 1) % MF_NUM_ENC_BANKS);
+				break;
+			}
 
-		if (enc->update_display == 0) {
-			enc->update_display = systime_ms();
+			case SIDE_SW_MODE_BANK_DIRECT: {
+				mf_bank_select(sw->bank);
+				break;
+			}
+
+			case SIDE_SW_MODE_NONE:
+			default: break;
 		}
 	}
 }
 
-static void vmap_update(mf_encoder_s* enc, virtmap_s* vmap) {
-	i16 newpos = vmap->curr_pos + enc->enc_ctx.velocity;
-	newpos		 = CLAMP(newpos, ENC_MIN, ENC_MAX);
-	newpos		 = CLAMP(newpos, vmap->position.start, vmap->position.stop);
+static void bank_feedback(u8 bank) {
+	send_cc(MF_BANK_FEEDBACK_CHANNEL, bank, MIDI_CC_MAX);
+}
 
-	if ((vmap->curr_pos == newpos) ||
-			!(IN_RANGE(newpos, vmap->position.start, vmap->position.stop))) {
-		return;
+// Slow the encoder down by fine_div, the LEDs show when it is active
+static void fine_adjust(mf_encoder_s* enc, bool fine) {
+	enc->fine						= fine;
+	enc->update_display = true;
+	encoder_set_divisor(&enc->enc_ctx, fine ? enc->fine_div : 1);
+}
+
+// Clear the state latched by a held switch, as if it had been released
+static void hold_release(mf_encoder_s* enc) {
+	if (enc->sw_mode == SW_MODE_VMAP_HOLD && enc->vmap_active != 0) {
+		enc->vmap_active		= 0;
+		enc->update_display = true;
+	} else if (enc->sw_mode == SW_MODE_FINE_ADJUST_HOLD && enc->fine) {
+		fine_adjust(enc, false);
 	}
+}
 
-	vmap->curr_pos = (u8)newpos;
+// Returns true if the position of the mapping changed
+static bool vmap_update(mf_encoder_s* enc, virtmap_s* vmap) {
+	const u16 start	 = vmap_start(vmap);
+	const u16 stop	 = vmap_stop(vmap);
+	i32				newpos = (i32)vmap->curr_pos + enc->enc_ctx.velocity;
+	newpos					 = CLAMP(newpos, 0, ENC_POS_MAX);
+	newpos					 = CLAMP(newpos, start, stop);
+
+	// Relative mappings are endless, movement is sent even at the ends
+	if (is_relative(vmap)) {
+		rel_update(vmap, enc->enc_ctx.velocity);
+	} else if (vmap->lagging &&
+						 !pickup_update(vmap, enc->enc_ctx.velocity, &newpos)) {
+		return false;
+	}
+
+	if ((vmap->curr_pos == newpos) || !(IN_RANGE(newpos, start, stop))) {
+		return false;
+	}
+
+	vmap->curr_pos = (u16)newpos;
 
 	switch (vmap->cfg.type) {
 
@@ -278,9 +586,7 @@ static void vmap_update(mf_encoder_s* enc, virtmap_s* vmap) {
 				case MIDI_MODE_CC: {
 					bool invert = (vmap->range.lower > vmap->range.upper);
 
-					i16 val = convert_range_i16(vmap->curr_pos, vmap->position.start,
-																			vmap->position.stop, vmap->range.lower,
-																			vmap->range.upper);
+					i16 val = vmap_value(vmap, vmap->range.lower, vmap->range.upper);
 
 					if (invert) {
 						val = MIDI_CC_MAX - val;
@@ -290,23 +596,27 @@ static void vmap_update(mf_encoder_s* enc, virtmap_s* vmap) {
 						break;
 					}
 
-					vmap->curr_val = val;
-
-					midi_event_s midi_evt;
-					midi_evt.type						 = MIDI_EVENT_CC;
-					midi_evt.data.cc.channel = vmap->cfg.midi.channel;
-					midi_evt.data.cc.control = vmap->cfg.midi.cc;
-					midi_evt.data.cc.value	 = val & MIDI_CC_MAX;
-					event_post(EVENT_CHANNEL_MIDI_OUT, &midi_evt);
+					// Replaces a value for the same control that is still queued
+					midi_event_s midi_evt = {
+							.type						 = MIDI_EVENT_CC_VALUE,
+							.data.cc.channel = vmap->cfg.midi.channel,
+							.data.cc.control = vmap->cfg.midi.cc,
+							.data.cc.value	 = val & MIDI_CC_MAX,
+					};
+
+					if (event_post_size(EVENT_CHANNEL_MIDI_OUT, &midi_evt,
+															MIDI_CC_EVENT_SIZE) == 0) {
+						vmap->curr_val = val;
+					}
 					break;
 				}
 
 				case MIDI_MODE_CC_14: {
 					bool invert = (vmap->range.lower > vmap->range.upper);
 
-					i16 val = convert_range_i16(vmap->curr_pos, vmap->position.start,
-																			vmap->position.stop, vmap->range.lower,
-																			vmap->range.upper);
+					// The range is configured in 7 bits, scale it to the full 14 bits
+					i16 val = vmap_value(vmap, cc14(vmap->range.lower),
+															 cc14(vmap->range.upper));
 
 					if (invert) {
 						val = 0x3FFF - val;
@@ -316,27 +626,49 @@ static void vmap_update(mf_encoder_s* enc, virtmap_s* vmap) {
 						break;
 					}
 
-					vmap->curr_val = val;
+					// Both halves or neither, a value that does not fit is retried on
+					// the next update (curr_val is unchanged)
+					if (!event_space(EVENT_CHANNEL_MIDI_OUT, MIDI_CC_EVENT_SIZE, 2)) {
+						break;
+					}
 
-					midi_event_s midi_evt;
 					// Send the MSB
-					midi_evt.type						 = MIDI_EVENT_CC;
-					midi_evt.data.cc.channel = vmap->cfg.midi.channel;
-					midi_evt.data.cc.control = vmap->cfg.midi.cc;
-					midi_evt.data.cc.value	 = (val >> 7) & 0x7F;
-					event_post(EVENT_CHANNEL_MIDI_OUT, &midi_evt);
+					midi_event_s* midi_evt =
+							event_reserve_size(EVENT_CHANNEL_MIDI_OUT, MIDI_CC_EVENT_SIZE);
+					assert(midi_evt);
+					midi_evt->type						= MIDI_EVENT_CC;
+					midi_evt->data.cc.channel = vmap->cfg.midi.channel;
+					midi_evt->data.cc.control = vmap->cfg.midi.cc;
+					midi_evt->data.cc.value		= (val >> 7) & 0x7F;
+					event_commit(EVENT_CHANNEL_MIDI_OUT);
 
 					// Then the LSB
-					midi_evt.data.cc.control = (u8)vmap->cfg.midi.cc + 32;
-					midi_evt.data.cc.value	 = val & 0x7F;
-					event_post(EVENT_CHANNEL_MIDI_OUT, &midi_evt);
+					midi_evt =
+							event_reserve_size(EVENT_CHANNEL_MIDI_OUT, MIDI_CC_EVENT_SIZE);
+					assert(midi_evt);
+					midi_evt->type						= MIDI_EVENT_CC;
+					midi_evt->data.cc.channel = vmap->cfg.midi.channel;
+					midi_evt->data.cc.control = (u8)vmap->cfg.midi.cc + 32;
+					midi_evt->data.cc.value		= val & 0x7F;
+					event_commit(EVENT_CHANNEL_MIDI_OUT);
+
+					vmap->curr_val = val;
 					break;
 				}
 
-				case MIDI_MODE_REL_CC: {
+				case MIDI_MODE_REL_CC:
+				case MIDI_MODE_REL_CC_OFFSET:
+				case MIDI_MODE_REL_CC_SIGNED: {
+					// Already sent by rel_update()
 					break;
 				}
-				case MIDI_MODE_NOTE: {
+				case MIDI_MODE_NOTE:
+				case MIDI_MODE_NOTE_PITCH: {
+					i16 val = vmap_value(vmap, vmap->range.lower, vmap->range.upper);
+
+					if (vmap->curr_val != val) {
+						note_update(enc, vmap, val);
+					}
 					break;
 				}
 			}
@@ -351,47 +683,389 @@ static void vmap_update(mf_encoder_s* enc, virtmap_s* vmap) {
 		case PROTOCOL_NONE:
 		default: break;
 	}
+
+	return true;
+}
+
+/*
+	Relative output, the movement is accumulated in rel_acc and sent as a
+	single delta, scaled by the range over the positions like the absolute
+	modes. Movement that does not add up to a full step yet is kept for the
+	next update, as is everything when the midi queue is full. A delta larger
+	than the encoding allows (a fast spin) is clamped and the excess dropped,
+	so nothing keeps trickling out after the encoder has stopped.
+*/
+static void rel_update(virtmap_s* vmap, i16 velocity) {
+	// Keep the movement within what rel_acc can hold
+	i32 acc				= (i32)vmap->rel_acc + velocity;
+	acc						= CLAMP(acc, -(i32)INT16_MAX, (i32)INT16_MAX);
+	vmap->rel_acc = (i16)acc;
+
+	u16 steps = scale_apply(&vmap->to_val, (u16)((acc < 0) ? -acc : acc));
+	if (steps == 0) {
+		return;
+	}
+
+	midi_event_s* midi_evt =
+			event_reserve_size(EVENT_CHANNEL_MIDI_OUT, MIDI_CC_EVENT_SIZE);
+	if (midi_evt == NULL) {
+		return;
+	}
+
+	if (steps > MIDI_REL_CC_MAX) {
+		steps					= MIDI_REL_CC_MAX;
+		vmap->rel_acc = 0;
+	} else {
+		// Keep the part of the movement that the steps do not account for
+		u16 used			= scale_apply(&vmap->to_pos, steps);
+		vmap->rel_acc = (i16)((acc < 0) ? acc + used : acc - used);
+	}
+
+	// A reversed range reverses the direction, as for the absolute modes
+	bool negative = (acc < 0) != (vmap->range.lower > vmap->range.upper);
+	i8	 delta		= negative ? -(i8)steps : (i8)steps;
+
+	midi_evt->type						= MIDI_EVENT_CC;
+	midi_evt->data.cc.channel = vmap->cfg.midi.channel;
+	midi_evt->data.cc.control = vmap->cfg.midi.cc;
+	midi_evt->data.cc.value		= rel_encode(vmap->cfg.midi.mode, delta);
+	event_commit(EVENT_CHANNEL_MIDI_OUT);
 }
 
-static int midi_in_handler(void* evt) {
-	midi_event_s* midi = (midi_event_s*)evt;
+/*
+	Soft takeover while the controller lags behind a host value. The
+	controller moves ctrl_pos, curr_pos stays at the host value (and on the
+	LEDs) until the pickup mode lets the controller take over. Returns true
+	with the new value position in newpos if the value moves.
+*/
+static bool pickup_update(virtmap_s* vmap, i16 velocity, i32* newpos) {
+	const u16 start = vmap_start(vmap);
+	const u16 stop	= vmap_stop(vmap);
+	const u16 ctrl	= vmap->ctrl_pos;
+	const u16 host	= CLAMP(vmap->curr_pos, start, stop);
+
+	i32 next			 = (i32)ctrl + velocity;
+	next					 = CLAMP(next, start, stop);
+	vmap->ctrl_pos = (u16)next;
+
+	if (next == ctrl) {
+		return false;
+	}
 
-	switch (midi->type) {
-		case MIDI_EVENT_CC: {
-			for (uint b = 0; b < MF_NUM_ENC_BANKS; b++) {
-				for (uint e = 0; e < MF_NUM_ENCODERS; e++) {
-					mf_encoder_s* enc = &gENCODERS[b][e];
-
-					for (int v = 0; v < MF_NUM_VMAPS_PER_ENC; v++) {
-						virtmap_s* vmap = &enc->vmaps[v];
-						if (vmap->cfg.type != PROTOCOL_MIDI) {
-							continue;
-						} else if (vmap->cfg.midi.channel != midi->data.cc.channel) {
-							continue;
-						} else if (vmap->cfg.midi.cc != midi->data.cc.control) {
-							continue;
-						}
-
-						u32 timenow = systime_ms();
-
-						// do not update if the encoder is moving.
-						if (enc->enc_ctx.velocity != 0) {
-							continue;
-						}
-						u16 newpos = (u16)convert_range_i16(
-								midi->data.cc.value, vmap->range.lower, vmap->range.upper,
-								vmap->position.start, vmap->position.stop);
-
-						vmap->curr_pos = newpos;
-					}
-				}
+	if (vmap->pickup == VIRTMAP_PICKUP_CATCH) {
+		// Picked up when the controller reaches or crosses the host value
+		if ((ctrl <= host && next >= host) || (ctrl >= host && next <= host)) {
+			vmap->lagging = false;
+			*newpos				= next;
+			return true;
+		}
+		return false;
+	}
+
+	// VIRTMAP_PICKUP_SCALE, the value covers the same share of the room left
+	// towards the end as the controller did, both meet there at the latest.
+	i32 value;
+	if (next == stop || next == start) {
+		value = next;
+	} else if (next > ctrl) {
+		value = host + (i32)((u32)(next - ctrl) * (u16)(stop - host) /
+												 (u16)(stop - ctrl));
+	} else {
+		value = host - (i32)((u32)(ctrl - next) * (u16)(host - start) /
+												 (u16)(ctrl - start));
+	}
+
+	if (span(value, next) <= scale_apply(&vmap->to_pos, 1)) {
+		vmap->lagging = false;
+		value					= next;
+	}
+
+	*newpos = value;
+	return true;
+}
+
+/*
+	Returns true if a feedback value is the last value sent. Otherwise it is
+	taken as the last value, so that it is not sent back to the host.
+*/
+static bool feedback_echo(virtmap_s* vmap, u8 value) {
+	if (vmap->cfg.type != PROTOCOL_MIDI) {
+		return false;
+	}
+
+	switch (vmap->cfg.midi.mode) {
+		case MIDI_MODE_CC: {
+			if (vmap->curr_val == value) {
+				return true;
 			}
+			vmap->curr_val = value;
+			return false;
+		}
+
+		// Only the MSB is fed back
+		case MIDI_MODE_CC_14: {
+			if ((vmap->curr_val >> 7) == value) {
+				return true;
+			}
+			vmap->curr_val = (i16)(value << 7);
+			return false;
+		}
+
+		default: return false;
+	}
+}
+
+static bool is_relative(const virtmap_s* vmap) {
+	if (vmap->cfg.type != PROTOCOL_MIDI) {
+		return false;
+	}
+
+	switch (vmap->cfg.midi.mode) {
+		case MIDI_MODE_REL_CC:
+		case MIDI_MODE_REL_CC_OFFSET:
+		case MIDI_MODE_REL_CC_SIGNED: return true;
+		default: return false;
+	}
+}
+
+// Encode a delta of at most +/- MIDI_REL_CC_MAX as a relative CC value
+static u8 rel_encode(u8 mode, i8 delta) {
+	switch (mode) {
+		case MIDI_MODE_REL_CC_OFFSET: return (u8)(64 + delta);
+		case MIDI_MODE_REL_CC_SIGNED:
+			return (delta < 0) ? (u8)(0x40 | -delta) : (u8)delta;
+		case MIDI_MODE_REL_CC:
+		default: return (u8)delta & 0x7F;
+	}
+}
+
+/*
+	Note output. MIDI_MODE_NOTE plays the cc as a note with the value as the
+	velocity, the note starts when the value leaves 0 and is held (a new
+	velocity does not retrigger it) until the value is back at 0.
+	MIDI_MODE_NOTE_PITCH plays the value as the note at full velocity, a new
+	note releases the previous one first. A value that cannot be sent is
+	retried on the next update, curr_val is only taken once it is queued.
+*/
+static void note_update(mf_encoder_s* enc, virtmap_s* vmap, i16 val) {
+	const u8	 idx	 = (u8)(vmap - enc->vmaps);
+	const u8	 bit	 = (u8)(1u << idx);
+	const bool pitch = (vmap->cfg.midi.mode == MIDI_MODE_NOTE_PITCH);
+	const bool on		 = pitch || val > 0;
+	const bool held	 = (enc->gates & bit) && !(enc->gates_off & bit);
+
+	if (!pitch && held && on) {
+		vmap->curr_val = val;
+		return;
+	}
+
+	// The off and the new on are queued together, or not at all
+	if (on && !event_space(EVENT_CHANNEL_MIDI_OUT, MIDI_NOTE_EVENT_SIZE, 2)) {
+		return;
+	}
+
+	if (!gate_off(enc, idx)) {
+		return;
+	}
+
+	if (on && !gate_on(enc, idx, vmap->cfg.midi.channel,
+										 pitch ? (u8)val : vmap->cfg.midi.raw,
+										 pitch ? MIDI_CC_MAX : (u8)val, false)) {
+		return;
+	}
+
+	vmap->curr_val = val;
+}
+
+// Encoder switch gate, a note or a CC (127 while held, 0 on release)
+static void sw_gate(mf_encoder_s* enc, bool on) {
+	const proto_cfg_s* cfg = &enc->sw_cfg;
+
+	if (!on) {
+		gate_off(enc, MF_NUM_VMAPS_PER_ENC);
+		return;
+	}
+
+	if (cfg->type != PROTOCOL_MIDI) {
+		return;
+	}
+
+	// Pressed again before the off was sent, the gate simply stays on
+	if (enc->gates_off & MF_GATE_SW) {
+		enc->gates_off &= (u8)~MF_GATE_SW;
+		return;
+	}
+
+	switch (cfg->midi.mode) {
+		case MIDI_MODE_DISABLED: return;
 
+		case MIDI_MODE_NOTE:
+		case MIDI_MODE_NOTE_PITCH: {
+			gate_on(enc, MF_NUM_VMAPS_PER_ENC, cfg->midi.channel, cfg->midi.raw,
+							MIDI_CC_MAX, false);
 			break;
 		}
+
+		default: {
+			gate_on(enc, MF_NUM_VMAPS_PER_ENC, cfg->midi.channel, cfg->midi.raw,
+							MIDI_CC_MAX, true);
+			break;
+		}
+	}
+}
+
+/*
+	Open gate idx (a vmap index, or MF_NUM_VMAPS_PER_ENC for the switch) with a
+	note or CC on. The channel and number are kept for the off, so it is sent
+	to the same note even if the configuration changes while the gate is on.
+	Returns false, with the gate left off, if the on did not fit in the queue.
+*/
+static bool gate_on(mf_encoder_s* enc, u8 idx, u8 channel, u8 note, u8 value,
+										bool cc) {
+	note &= MIDI_CC_MAX;
+
+	if (!(cc ? send_cc(channel, note, value) : send_note(channel, note, value))) {
+		return false;
 	}
 
-	return 0;
+	enc->gate[idx].channel = cc ? (u8)(channel | MF_GATE_CC) : channel;
+	enc->gate[idx].note		 = note;
+	enc->gates						|= (u8)(1u << idx);
+	return true;
+}
+
+/*
+	Release gate idx (a vmap index, or MF_NUM_VMAPS_PER_ENC for the switch).
+	An off must never be lost, if the midi queue is full the gate stays on and
+	is marked in gates_off, gates_update() then retries until it is sent.
+	Returns true once the gate is off.
+*/
+static bool gate_off(mf_encoder_s* enc, u8 idx) {
+	const u8 bit = (u8)(1u << idx);
+	bool		 sent;
+
+	if ((enc->gates & bit) == 0) {
+		return true;
+	}
+
+	// Sent to the channel and note of the on, not the current configuration
+	const mf_gate_s* gate		 = &enc->gate[idx];
+	const u8				 channel = gate->channel & (u8)~MF_GATE_CC;
+
+	if (gate->channel & MF_GATE_CC) {
+		sent = send_cc(channel, gate->note, 0);
+	} else {
+		sent = send_note(channel, gate->note, 0);
+	}
+
+	if (!sent) {
+		enc->gates_off |= bit;
+		gates_pending	 = true;
+		return false;
+	}
+
+	enc->gates &= (u8)~bit;
+	enc->gates_off &= (u8)~bit;
+	return true;
+}
+
+// Retry the gate offs that did not fit in the midi queue, in every bank
+static void gates_update(void) {
+	if (!gates_pending) {
+		return;
+	}
+
+	gates_pending = false;
+
+	for (uint b = 0; b < MF_NUM_ENC_BANKS; b++) {
+		for (uint e = 0; e < MF_NUM_ENCODERS; e++) {
+			mf_encoder_s* enc = &gENCODERS[b][e];
+
+			for (u8 i = 0; enc->gates_off != 0 && i <= MF_NUM_VMAPS_PER_ENC; i++) {
+				if (enc->gates_off & (1u << i)) {
+					gate_off(enc, i);
+				}
+			}
+		}
+	}
+}
+
+static void notes_off(u8 bank) {
+	for (uint e = 0; e < MF_NUM_ENCODERS; e++) {
+		mf_encoder_s* enc = &gENCODERS[bank][e];
+
+		for (u8 i = 0; enc->gates != 0 && i <= MF_NUM_VMAPS_PER_ENC; i++) {
+			gate_off(enc, i);
+		}
+	}
+}
+
+// Returns false if the midi queue is full
+static bool send_note(u8 channel, u8 note, u8 velocity) {
+	midi_event_s* midi_evt =
+			event_reserve_size(EVENT_CHANNEL_MIDI_OUT, MIDI_NOTE_EVENT_SIZE);
+	if (midi_evt == NULL) {
+		return false;
+	}
+
+	const u8 type = velocity ? MIDI_EVENT_NOTE_ON : MIDI_EVENT_NOTE_OFF;
+
+	midi_evt->type							 = type;
+	midi_evt->data.note.channel	 = channel;
+	midi_evt->data.note.note		 = note & MIDI_CC_MAX;
+	midi_evt->data.note.velocity = velocity & MIDI_CC_MAX;
+	return event_commit(EVENT_CHANNEL_MIDI_OUT) == 0;
+}
+
+// Returns false if the midi queue is full
+static bool send_cc(u8 channel, u8 control, u8 value) {
+	midi_event_s* midi_evt =
+			event_reserve_size(EVENT_CHANNEL_MIDI_OUT, MIDI_CC_EVENT_SIZE);
+	if (midi_evt == NULL) {
+		return false;
+	}
+
+	midi_evt->type						= MIDI_EVENT_CC;
+	midi_evt->data.cc.channel = channel;
+	midi_evt->data.cc.control = control;
+	midi_evt->data.cc.value		= value & MIDI_CC_MAX;
+	return event_commit(EVENT_CHANNEL_MIDI_OUT) == 0;
+}
+
+// First position of a virtual mapping
+static u16 vmap_start(const virtmap_s* vmap) {
+	return ENC_POS(vmap->position.start);
+}
+
+// Last position of a virtual mapping, including the sub-LED positions
+static u16 vmap_stop(const virtmap_s* vmap) {
+	return ENC_POS(vmap->position.stop) | (ENC_POS(1) - 1);
+}
+
+// Value at the current position, from lower (at start) to upper (at stop)
+static i16 vmap_value(const virtmap_s* vmap, i16 lower, i16 upper) {
+	u16 offset = scale_apply(&vmap->to_val, vmap->curr_pos - vmap_start(vmap));
+	return (upper >= lower) ? lower + (i16)offset : lower - (i16)offset;
+}
+
+// Position for a 7-bit value, the inverse of vmap_value()
+static u16 vmap_position(const virtmap_s* vmap, i8 value) {
+	const i8 lower = vmap->range.lower;
+	const i8 upper = vmap->range.upper;
+
+	i16 offset = (upper >= lower) ? value - lower : lower - value;
+	offset		 = CLAMP(offset, 0, (i16)span(lower, upper));
+
+	return vmap_start(vmap) + scale_apply(&vmap->to_pos, (u16)offset);
+}
+
+static u16 span(i32 a, i32 b) {
+	return (u16)((a > b) ? a - b : b - a);
+}
+
+// Scale a 7 bit CC value to 14 bits (0 -> 0x0000, 127 -> 0x3FFF)
+static i16 cc14(i8 val) {
+	return (i16)((val << 7) | val);
 }
 
 static void print_dir(uint enc_idx, int dir) {
@@ -19,21 +19,34 @@
 #include "usb/usb.h"
 #include "protocol/midi/midi.h"
 #include "event/event.h"
-#include "display/display.h"
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+// Time (us) the event system may spend per main loop pass
+#define EVENT_UPDATE_BUDGET_US (500)
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 mf_rt_s gRT = {
-		.curr_bank = 0,
+		.curr_bank		 = 0,
+		.bank_feedback = false,
+		.side_sw =
+				{
+						[0] = {.mode = SIDE_SW_MODE_BANK_PREV},
+						[1] = {.mode = SIDE_SW_MODE_BANK_NEXT},
+						[3] = {.mode = SIDE_SW_MODE_BANK_DIRECT, .bank = 0},
+						[4] = {.mode = SIDE_SW_MODE_BANK_DIRECT, .bank = 1},
+						[5] = {.mode = SIDE_SW_MODE_BANK_DIRECT, .bank = 2},
+				},
 };
 
 sys_config_s gCONFIG = {
-		.enc_dead_time			= DEFAULT_ENC_PLAYDEAD_TIME,
-		.midi_throttle_time = DEFAULT_MIDI_THROTTLE_TIME,
+		.enc_dead_time			 = DEFAULT_ENC_PLAYDEAD_TIME,
+		.midi_throttle_time	 = DEFAULT_MIDI_THROTTLE_TIME,
+		.gesture_long_time	 = DEFAULT_GESTURE_LONG_TIME,
+		.gesture_double_time = DEFAULT_GESTURE_DOUBLE_TIME,
 };
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -44,9 +57,7 @@ __attribute__((noreturn)) void main(void) {
 	avr_xmega128a4u_init(); // Init the AVR xmega peripherals
 
 	event_init();
-	midi_init();
 	mf_input_init();
-	mf_sysex_init();
 	systime_start();
 	usb_init();
 
@@ -73,16 +84,26 @@ __attribute__((noreturn)) void main(void) {
 	}
 
 	hw_led_init();
+	mf_display_init();
 
 	// println_pmem("Init done");
 
+	bool configured = false;
+
 	while (1) {
 		mf_input_update();
-		event_update();
-		display_update();
+		event_update(EVENT_UPDATE_BUDGET_US);
 		midi_update();
 		usb_update();
-		mf_cfg_update();
+
+		// Nothing is left playing across a disconnect. The offs can only be sent
+		// once the host is listening again, so notes that are still on are
+		// released when the device is configured.
+		bool now_configured = (USB_DeviceState == DEVICE_STATE_Configured);
+		if (!configured && now_configured) {
+			mf_notes_off();
+		}
+		configured = now_configured;
 	}
 }
 
@@ -10,6 +10,7 @@
 #include "sys/print.h"
 #include "event/midi.h"
 #include "protocol/midi/midi.h"
+#include "trace/trace.h"
 #include "platform/midifighter/usb.h"
 
 #include "LUFA/Common/Common.h"
@@ -19,13 +20,23 @@
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-#define MIDI_EVENT_QUEUE_SIZE 16
+#define MIDI_EVENT_QUEUE_SIZE		16
+#define MIDI_IN_EVENT_QUEUE_QUANTUM 8
+STATIC_ASSERT(IS_POW2(MIDI_EVENT_QUEUE_SIZE), "Queue size must be a power of 2");
+
+// Host messages are CC or sysex packets, so the in queue slots only need to
+// hold the larger of the two (not a whole midi_event_s).
+#define MIDI_IN_EVENT_SIZE MIDI_EVENT_SIZE(midi_sysex_in_event_s)
+
+// The out queue holds variable length events, in bytes
+#define MIDI_OUT_QUEUE_BYTES 128
+STATIC_ASSERT(sizeof(midi_event_s) < (MIDI_OUT_QUEUE_BYTES / 2),
+							"Sysex out events must fit in half of the queue");
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static int							 midi_out_handler(void* event);
 static midi_sysex_type_e midi_sysex_type(u8 evt);
 static int							 lufa_transmit(u8* data, u8 len);
 
@@ -51,66 +62,70 @@ USB_ClassInfo_MIDI_Device_t lufa_usb_midi_device = {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static midi_event_s midi_in_event_queue[MIDI_EVENT_QUEUE_SIZE];
-static midi_event_s midi_out_event_queue[MIDI_EVENT_QUEUE_SIZE];
+static u8 midi_in_event_queue[MIDI_EVENT_QUEUE_SIZE * MIDI_IN_EVENT_SIZE];
+static u8 midi_out_event_queue[MIDI_OUT_QUEUE_BYTES];
 
-static event_ch_handler_s midi_out_event_handler = {
-		.handler	= midi_out_handler,
-		.next			= NULL,
-		.priority = 0,
-};
+#ifdef EVENT_HIST_ENABLE
+static u16 midi_in_event_stamps[MIDI_EVENT_QUEUE_SIZE];
+static u16 midi_out_event_stamps[MIDI_OUT_QUEUE_BYTES]; // One per byte
+#endif
 
 event_channel_s midi_in_event_ch = {
-		.queue			= (u8*)midi_in_event_queue,
+		.queue			= midi_in_event_queue,
 		.queue_size = MIDI_EVENT_QUEUE_SIZE,
-		.data_size	= sizeof(midi_event_s),
-		.handlers		= NULL,
-		.onehandler = false,
+		.data_size	= MIDI_IN_EVENT_SIZE,
+		.quantum		= MIDI_IN_EVENT_QUEUE_QUANTUM,
+		.guaranteed = false,
+#ifdef EVENT_HIST_ENABLE
+		.stamps = midi_in_event_stamps,
+#endif
 };
 
 event_channel_s midi_out_event_ch = {
-		.queue			= (u8*)midi_out_event_queue,
-		.queue_size = MIDI_EVENT_QUEUE_SIZE,
+		.queue			= midi_out_event_queue,
+		.queue_size = MIDI_OUT_QUEUE_BYTES,
 		.data_size	= sizeof(midi_event_s),
-		.handlers		= NULL,
-		.onehandler = false,
+		.variable		= true,
+		.quantum		= 0,		// Always drain, MIDI out must never starve
+		.guaranteed = true,
+		.merge			= midi_event_merge, // Only the latest value of a control
+#ifdef EVENT_HIST_ENABLE
+		.stamps = midi_out_event_stamps,
+#endif
 };
 
 // Transmit buffer for USB MIDI packets (must 4 bytes, do not change!)
 static u8 tx_buf[4];
 
-/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
-
-int midi_init(void) {
-	int ret = event_channel_register(EVENT_CHANNEL_MIDI_IN, &midi_in_event_ch);
-	RETURN_ON_ERR(ret);
-
-	ret = event_channel_register(EVENT_CHANNEL_MIDI_OUT, &midi_out_event_ch);
-	RETURN_ON_ERR(ret);
-
-	ret =
-			event_channel_subscribe(EVENT_CHANNEL_MIDI_OUT, &midi_out_event_handler);
-	RETURN_ON_ERR(ret);
+// Code index for the last packet of a sysex, by the number of bytes in it
+static const u8 sysex_end_cin[3] = {
+		MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_1BYTE),
+		MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_2BYTE),
+		MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_3BYTE),
+};
 
-	return ret;
-}
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int midi_update(void) {
 	MIDI_EventPacket_t rx;
 
-	while (MIDI_Device_ReceiveEventPacket(&lufa_usb_midi_device, &rx)) {
+	// Host messages must not be lost, while the queue is full they are left in
+	// the endpoint and the host is held off until there is space.
+	while (event_space(EVENT_CHANNEL_MIDI_IN, MIDI_IN_EVENT_SIZE, 1) &&
+				 MIDI_Device_ReceiveEventPacket(&lufa_usb_midi_device, &rx)) {
 
 		switch (rx.Event) {
 			case MIDI_EVENT(0, MIDI_COMMAND_CONTROL_CHANGE): {
 				// println_pmem("Rx CC:");
-				midi_cc_event_s cc;
-				cc.channel = (rx.Data1 & 0x0F);
-				cc.control = rx.Data2;
-				cc.value	 = rx.Data3;
+				midi_event_s* e = event_reserve(EVENT_CHANNEL_MIDI_IN);
+				if (e == NULL) {
+					break;
+				}
 
-				midi_event_s e;
-				e.type		= MIDI_EVENT_CC;
-				e.data.cc = cc;
+				e->type						 = MIDI_EVENT_CC;
+				e->data.cc.channel = (rx.Data1 & 0x0F);
+				e->data.cc.control = rx.Data2;
+				e->data.cc.value	 = rx.Data3;
 
 #ifdef VSER_ENABLE
 #warning "Clib printf functions use lots of memory."
@@ -120,7 +135,7 @@ int midi_update(void) {
 				// cc.value); println(buf);
 #endif
 
-				event_post(EVENT_CHANNEL_MIDI_IN, &e);
+				event_commit(EVENT_CHANNEL_MIDI_IN);
 				break;
 			}
 
@@ -130,16 +145,18 @@ int midi_update(void) {
 			case MIDI_EVENT(0, MIDI_COMMAND_SYSEX_START_3BYTE): //  >= 4 bytes
 			case MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_2BYTE):
 			case MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_3BYTE): {
-				midi_event_s e = {
-						.type = MIDI_EVENT_SYSEX,
-						.data.sysex_in =
-								{
-										.type = midi_sysex_type(rx.Event),
-										.data = {rx.Data1, rx.Data2, rx.Data3},
-								},
-				};
+				midi_event_s* e = event_reserve(EVENT_CHANNEL_MIDI_IN);
+				if (e == NULL) {
+					break;
+				}
 
-				event_post(EVENT_CHANNEL_MIDI_IN, &e);
+				e->type								= MIDI_EVENT_SYSEX;
+				e->data.sysex_in.type		= midi_sysex_type(rx.Event);
+				e->data.sysex_in.data[0] = rx.Data1;
+				e->data.sysex_in.data[1] = rx.Data2;
+				e->data.sysex_in.data[2] = rx.Data3;
+
+				event_commit(EVENT_CHANNEL_MIDI_IN);
 
 				// transmit back to host
 				// MIDI_Device_SendEventPacket(&lufa_usb_midi_device, &rx);
@@ -153,9 +170,7 @@ int midi_update(void) {
 	return 0;
 }
 
-/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
-
-static int midi_out_handler(void* event) {
+int midi_out_handler(void* event) {
 	assert(event);
 
 	midi_event_s* e = (midi_event_s*)event;
@@ -163,7 +178,8 @@ static int midi_out_handler(void* event) {
 	MIDI_EventPacket_t pkt = {0};
 
 	switch (e->type) {
-		case MIDI_EVENT_CC: {
+		case MIDI_EVENT_CC:
+		case MIDI_EVENT_CC_VALUE: {
 			midi_cc_event_s* cc = &e->data.cc;
 			// println_pmem("Tx CC:");
 
@@ -173,100 +189,62 @@ static int midi_out_handler(void* event) {
 			pkt.Data3 = (cc->value & 0x7F);
 
 			MIDI_Device_SendEventPacket(&lufa_usb_midi_device, &pkt);
+			TRACE_MARK(TRACE_STAGE_USB);
 			break;
 		}
 
-		case MIDI_EVENT_SYSEX: {
-			midi_sysex_out_event_s* sysex = &e->data.sysex_out;
+		case MIDI_EVENT_NOTE_ON:
+		case MIDI_EVENT_NOTE_OFF: {
+			midi_note_event_s* note = &e->data.note;
+			const u8					 cmd	= (e->type == MIDI_EVENT_NOTE_ON)
+																		? MIDI_COMMAND_NOTE_ON
+																		: MIDI_COMMAND_NOTE_OFF;
 
-			tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_START_3BYTE);
-			tx_buf[1] = MIDI_STATUS_SYSTEM_EXCLUSIVE;
-			tx_buf[2] = MIDI_MFR_ID_1;
-			tx_buf[3] = MIDI_MFR_ID_2;
-			lufa_transmit(tx_buf, sizeof(tx_buf));
-
-			tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_START_3BYTE);
-			tx_buf[1] = MIDI_MFR_ID_3;
-			tx_buf[2] = sysex->cmd;
-			tx_buf[3] = sysex->param;
-			lufa_transmit(tx_buf, sizeof(tx_buf));
-
-			u8	 remaining = sysex->data_len;
-			u8*	 payload	 = sysex->data;
-			bool done			 = false;
-
-			switch (sysex->data_len) {
-				case 0: {
-					tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_1BYTE);
-					tx_buf[1] = MIDI_STATUS_END_OF_EXCLUSIVE;
-					tx_buf[2] = 0;
-					tx_buf[3] = 0;
-					done			= true;
-					break;
-				}
+			pkt.Event = MIDI_EVENT(0, cmd);
+			pkt.Data1 = ((note->channel & 0x0F) | cmd);
+			pkt.Data2 = (note->note & 0x7F);
+			pkt.Data3 = (note->velocity & 0x7F);
 
-				case 1: {
-					tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_3BYTE);
-					tx_buf[1] = sysex->data_len;
-					tx_buf[2] = *payload;
-					tx_buf[3] = MIDI_STATUS_END_OF_EXCLUSIVE;
-					done			= true;
-					break;
-				}
+			MIDI_Device_SendEventPacket(&lufa_usb_midi_device, &pkt);
+			TRACE_MARK(TRACE_STAGE_USB);
+			break;
+		}
 
-				default:
-				case 2: {
-					tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_START_3BYTE);
-					tx_buf[1] = sysex->data_len;
-					tx_buf[2] = *payload++;
-					tx_buf[3] = *payload++;
-					break;
-				}
-			}
+		case MIDI_EVENT_SYSEX: {
+			midi_sysex_out_event_s* sysex = &e->data.sysex_out;
 
-			lufa_transmit(tx_buf, sizeof(tx_buf));
+			// [sysex start] [mfid] [cmd] [param] [data_len] [data] [sysex end]
+			const u8 header[] = {
+					MIDI_STATUS_SYSTEM_EXCLUSIVE,
+					MIDI_MFR_ID_1,
+					MIDI_MFR_ID_2,
+					MIDI_MFR_ID_3,
+					sysex->cmd,
+					sysex->param,
+					sysex->data_len,
+			};
+			const u8 total = sizeof(header) + sysex->data_len + 1;
+
+			// Send 3 bytes per packet, the last packet also ends the sysex
+			for (u8 i = 0; i < total; i += 3) {
+				u8 count = MIN(3, total - i);
 
-			while (!done) {
 				memset(tx_buf, 0, sizeof(tx_buf));
-				switch (remaining) {
-					case 0: {
-						tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_1BYTE);
-						tx_buf[1] = MIDI_STATUS_END_OF_EXCLUSIVE;
-						done			= true;
-						remaining = 0;
-						break;
-					}
-
-					case 1: {
-						tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_2BYTE);
-						tx_buf[1] = sysex->data[*payload++];
-						tx_buf[2] = MIDI_STATUS_END_OF_EXCLUSIVE;
-						done			= true;
-						remaining = 0;
-						break;
-					}
-
-					case 2: {
-						tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_END_3BYTE);
-						tx_buf[1] = sysex->data[*payload++];
-						tx_buf[2] = sysex->data[*payload++];
-						tx_buf[3] = MIDI_STATUS_END_OF_EXCLUSIVE;
-						done			= true;
-						remaining = 0;
-						break;
+				for (u8 j = 0; j < count; j++) {
+					u8 pos = i + j;
+					if (pos < sizeof(header)) {
+						tx_buf[1 + j] = header[pos];
+					} else if (pos < total - 1) {
+						tx_buf[1 + j] = sysex->data[pos - sizeof(header)];
+					} else {
+						tx_buf[1 + j] = MIDI_STATUS_END_OF_EXCLUSIVE;
 					}
-
-					default:
-					case 3: {
-						tx_buf[0] = MIDI_EVENT(0, MIDI_COMMAND_SYSEX_START_3BYTE);
-						tx_buf[1] = sysex->data[*payload++];
-						tx_buf[2] = sysex->data[*payload++];
-						tx_buf[3] = sysex->data[*payload++];
-						remaining -= 3;
-						break;
-					}
-						lufa_transmit(tx_buf, sizeof(tx_buf));
 				}
+
+				tx_buf[0] = (i + count < total)
+												? MIDI_EVENT(0, MIDI_COMMAND_SYSEX_START_3BYTE)
+												: sysex_end_cin[count - 1];
+				lufa_transmit(tx_buf, sizeof(tx_buf));
 			}
 
 			break;
@@ -284,6 +262,8 @@ static int midi_out_handler(void* event) {
 	return 0;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 static midi_sysex_type_e midi_sysex_type(u8 evt) {
 	switch (evt) {
 		case MIDI_EVENT(0, MIDI_COMMAND_SYSEX_1BYTE): return SYSEX_TYPE_1BYTE;
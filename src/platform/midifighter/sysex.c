@@ -10,6 +10,7 @@
 
 #include "platform/midifighter/sysex.h"
 #include "event/midi.h"
+#include "trace/trace.h"
 
 // Test sequence:
 // [sysex start] [mfid] [cmd] [param] [data] [sysex end]
@@ -46,13 +47,14 @@ typedef struct {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static int midi_in_handler(void* evt);
+static int reply_event_stats(const mf_sysex_stats_param_s* param);
+static int reply_trace(const mf_sysex_trace_param_s* param);
+static int reply_value(u8 param_enum, u8 arg0, u8 arg1, u16 val);
+static int reply_status(u8 cmd, u8 param_enum, u8 status);
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-EVT_HANDLER(2, evt_midi, midi_in_handler);
-
 static u8 sysex_data_len[SYSEX_TYPE_NB] = {
 		[SYSEX_TYPE_1BYTE] = 1,			[SYSEX_TYPE_2BYTE] = 2,
 		[SYSEX_TYPE_3BYTE] = 3,			[SYSEX_TYPE_START_3BYTE] = 3,
@@ -85,7 +87,8 @@ static const sysex_item_data_info_s sysex_data_info[MF_SYSEX_PARAM_NB] = {
 	SYSEX_DATA_INFO(MF_SYSEX_PARAM_VMAP_RGB, virtmap_s, rgb),
 	SYSEX_DATA_INFO(MF_SYSEX_PARAM_VMAP_RB, virtmap_s, rb),
 	SYSEX_DATA_INFO(MF_SYSEX_PARAM_VMAP_PROTO, virtmap_s, cfg),
-	SYSEX_DATA_INFO(MF_SYSEX_PARAM_SIDE_SWITCH, mf_rt_s, curr_bank),
+	SYSEX_DATA_INFO(MF_SYSEX_PARAM_VMAP_PICKUP, virtmap_s, pickup),
+	SYSEX_DATA_INFO(MF_SYSEX_PARAM_SIDE_SWITCH, mf_rt_s, side_sw[0]),
 	SYSEX_DATA_INFO(MF_SYSEX_PARAM_ACTIVE_BANK, mf_rt_s, curr_bank),
 };
 
@@ -98,13 +101,7 @@ static u8							buffer_idx = 0;
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int mf_sysex_init(void) {
-	event_channel_subscribe(EVENT_CHANNEL_MIDI_IN, &evt_midi);
-}
-
-/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
-
-static int midi_in_handler(void* evt) {
+int mf_sysex_midi_handler(void* evt) {
 	int						ret	 = 0;
 	midi_event_s* midi = (midi_event_s*)evt;
 
@@ -194,6 +191,11 @@ static int midi_in_handler(void* evt) {
 					(void*)((u8*)encoder + sysex_data_info[msg->param_enum].offset);
 			memcpy(param, (const void*)&msg->param.enc.data,
 						 sysex_data_info[msg->param_enum].len);
+			encoder->update_display = true;
+
+			if (msg->param_enum == MF_SYSEX_PARAM_ENCODER_SWITCH_PROTO) {
+				mf_gate_release(encoder, MF_NUM_VMAPS_PER_ENC);
+			}
 			break;
 		}
 
@@ -210,14 +212,128 @@ static int midi_in_handler(void* evt) {
 					(void*)((u8*)vmap + sysex_data_info[msg->param_enum].offset);
 			memcpy(param, (const void*)&msg->param.vmap.data,
 						 sysex_data_info[msg->param_enum].len);
+			gENCODERS[bank_idx][enc_idx].update_display = true;
+			mf_vmap_scale_update(vmap);
+
+			if (msg->param_enum == MF_SYSEX_PARAM_VMAP_PROTO) {
+				mf_vmap_index_update(bank_idx, enc_idx, vmap_idx);
+				mf_gate_release(&gENCODERS[bank_idx][enc_idx], vmap_idx);
+			}
+			break;
+		}
+
+		case MF_SYSEX_PARAM_VMAP_PICKUP: {
+			const mf_sysex_vmap_param_s* p = &msg->param.vmap;
+			if (p->bank_idx >= MF_NUM_ENC_BANKS || p->enc_idx >= MF_NUM_ENCODERS ||
+					p->vmap_idx >= MF_NUM_VMAPS_PER_ENC) {
+				ret = ERR_BAD_PARAM;
+				break;
+			}
+
+			mf_encoder_s* enc	 = &gENCODERS[p->bank_idx][p->enc_idx];
+			virtmap_s*		vmap = &enc->vmaps[p->vmap_idx];
+
+			if (msg->cmd == MF_SYSEX_GET) {
+				u16 val = (u16)((p->vmap_idx << 14) | (vmap->lagging << 7) |
+												vmap->pickup);
+				ret			= reply_value(MF_SYSEX_PARAM_VMAP_PICKUP, p->bank_idx,
+															p->enc_idx, val);
+				goto cleanup;
+			} else if (p->data.pickup >= VIRTMAP_PICKUP_NB) {
+				ret = ERR_BAD_PARAM;
+			} else {
+				// The controller takes over straight away after a mode change
+				vmap->pickup				= p->data.pickup;
+				vmap->lagging				= false;
+				enc->update_display = true;
+			}
 			break;
 		}
 
 		case MF_SYSEX_PARAM_SIDE_SWITCH: {
+			const mf_sysex_sideswitch_param_s* sw = &msg->param.sw;
+			if (sw->sw_idx >= MF_NUM_SIDE_SWITCHES) {
+				ret = ERR_BAD_PARAM;
+			} else if (msg->cmd == MF_SYSEX_GET) {
+				const mf_side_switch_s* cfg = &gRT.side_sw[sw->sw_idx];
+				ret = reply_value(MF_SYSEX_PARAM_SIDE_SWITCH, sw->sw_idx, cfg->mode,
+													cfg->bank);
+				goto cleanup;
+			} else if (sw->mode >= SIDE_SW_MODE_NB ||
+								 sw->bank >= MF_NUM_ENC_BANKS) {
+				ret = ERR_BAD_PARAM;
+			} else {
+				gRT.side_sw[sw->sw_idx].mode = sw->mode;
+				gRT.side_sw[sw->sw_idx].bank = sw->bank;
+			}
 			break;
 		}
 
 		case MF_SYSEX_PARAM_ACTIVE_BANK: {
+			if (msg->cmd == MF_SYSEX_GET) {
+				ret = reply_value(MF_SYSEX_PARAM_ACTIVE_BANK, 0, gRT.bank_feedback,
+													gRT.curr_bank);
+				goto cleanup;
+			}
+
+			gRT.bank_feedback = (msg->param.bank.feedback != 0);
+			ret								= mf_bank_select(msg->param.bank.bank_idx);
+			break;
+		}
+
+		case MF_SYSEX_PARAM_EVENT_STATS: {
+			if (msg->cmd != MF_SYSEX_GET) {
+				ret = ERR_UNSUPPORTED;
+				goto cleanup;
+			}
+
+			// The reply carries the value, so it is sent from here
+			ret = reply_event_stats(&msg->param.stats);
+			goto cleanup;
+		}
+
+		case MF_SYSEX_PARAM_TRACE: {
+			if (msg->cmd != MF_SYSEX_GET) {
+				ret = ERR_UNSUPPORTED;
+				goto cleanup;
+			}
+
+			ret = reply_trace(&msg->param.trace);
+			goto cleanup;
+		}
+
+		case MF_SYSEX_PARAM_GESTURE_TIME: {
+			const mf_sysex_gesture_param_s* g = &msg->param.gesture;
+
+			u16* time = NULL;
+			switch (g->item) {
+				case MF_SYSEX_GESTURE_LONG: {
+					time = &gCONFIG.gesture_long_time;
+					break;
+				}
+
+				case MF_SYSEX_GESTURE_DOUBLE: {
+					time = &gCONFIG.gesture_double_time;
+					break;
+				}
+
+				default: break;
+			}
+
+			const u16 ms = (u16)(((g->msb & 0x7F) << 7) | (g->lsb & 0x7F));
+
+			if (time == NULL) {
+				ret = ERR_BAD_PARAM;
+			} else if (msg->cmd == MF_SYSEX_GET) {
+				ret = reply_value(MF_SYSEX_PARAM_GESTURE_TIME, g->item, 0, *time);
+				goto cleanup;
+			} else if (g->item == MF_SYSEX_GESTURE_LONG && ms == 0) {
+				ret = ERR_BAD_PARAM;
+			} else {
+				// Applied straight away, like the side switches it is not saved
+				*time = ms;
+				mf_gesture_cfg_update();
+			}
 			break;
 		}
 
@@ -232,32 +348,12 @@ static int midi_in_handler(void* evt) {
 
 	switch (msg->cmd) {
 		case MF_SYSEX_GET: {
-			midi_event_s reply = {
-					.type = MIDI_EVENT_SYSEX,
-					.data.sysex_out =
-							{
-									.cmd			= MF_SYSEX_GET_RESPONSE,
-									.param		= msg->param_enum,
-									.data_len = 1,
-									.data			= ret,
-							},
-			};
-			event_post(EVENT_CHANNEL_MIDI_OUT, &reply);
+			ret = reply_status(MF_SYSEX_GET_RESPONSE, msg->param_enum, ret);
 			break;
 		}
 
 		case MF_SYSEX_SET: {
-			midi_event_s reply = {
-					.type = MIDI_EVENT_SYSEX,
-					.data.sysex_out =
-							{
-									.cmd			= MF_SYSEX_SET_RESPONSE,
-									.param		= msg->param_enum,
-									.data_len = 1,
-									.data			= ret,
-							},
-			};
-			event_post(EVENT_CHANNEL_MIDI_OUT, &reply);
+			ret = reply_status(MF_SYSEX_SET_RESPONSE, msg->param_enum, ret);
 			break;
 		}
 
@@ -273,3 +369,102 @@ cleanup:
 	stream_state = STREAM_IDLE;
 	return ret;
 }
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int reply_event_stats(const mf_sysex_stats_param_s* param) {
+	if (param->channel >= EVENT_CHANNEL_NB) {
+		return ERR_BAD_PARAM;
+	}
+
+	const event_ch_stats_s* stats = event_channel_stats(param->channel);
+	if (stats == NULL) {
+		return ERR_BAD_PARAM;
+	}
+
+	u16 val;
+	switch (param->item) {
+		case MF_SYSEX_STATS_POSTS: val = stats->posts; break;
+		case MF_SYSEX_STATS_DROPS: val = stats->drops; break;
+		case MF_SYSEX_STATS_HIGH_WATER: val = stats->high_water; break;
+		case MF_SYSEX_STATS_HANDLER_CALLS: val = stats->handler_calls; break;
+
+		default: {
+#ifdef EVENT_HIST_ENABLE
+			if (param->item >= MF_SYSEX_STATS_NB) {
+				return ERR_BAD_PARAM;
+			} else if (param->item >= MF_SYSEX_STATS_HANDLER_HIST) {
+				val = stats->handler_hist[param->item - MF_SYSEX_STATS_HANDLER_HIST];
+			} else {
+				val = stats->queue_hist[param->item - MF_SYSEX_STATS_QUEUE_HIST];
+			}
+			break;
+#else
+			return ERR_UNSUPPORTED;
+#endif
+		}
+	}
+
+	return reply_value(MF_SYSEX_PARAM_EVENT_STATS, param->channel, param->item,
+										 val);
+}
+
+static int reply_trace(const mf_sysex_trace_param_s* param) {
+	if (param->stage >= TRACE_STAGE_NB) {
+		return ERR_BAD_PARAM;
+	}
+
+#ifdef TRACE_ENABLE
+	const trace_stat_s* stats = trace_stats(param->stage);
+
+	u16 val;
+	switch (param->item) {
+		case MF_SYSEX_TRACE_MIN: val = stats->min; break;
+		case MF_SYSEX_TRACE_AVG: val = trace_avg(param->stage); break;
+		case MF_SYSEX_TRACE_MAX: val = stats->max; break;
+		case MF_SYSEX_TRACE_COUNT: val = stats->count; break;
+		default: return ERR_BAD_PARAM;
+	}
+
+	return reply_value(MF_SYSEX_PARAM_TRACE, param->stage, param->item, val);
+#else
+	return ERR_UNSUPPORTED;
+#endif
+}
+
+static int reply_value(u8 param_enum, u8 arg0, u8 arg1, u16 val) {
+	midi_event_s* reply =
+			event_reserve_size(EVENT_CHANNEL_MIDI_OUT, MIDI_SYSEX_OUT_EVENT_SIZE(5));
+	if (reply == NULL) {
+		return ERR_NO_MEM;
+	}
+
+	// The value is split into 7-bit bytes (MSB first) to keep it sysex-safe
+	reply->type										= MIDI_EVENT_SYSEX;
+	reply->data.sysex_out.cmd			= MF_SYSEX_GET_RESPONSE;
+	reply->data.sysex_out.param		= param_enum;
+	reply->data.sysex_out.data_len = 5;
+	reply->data.sysex_out.data[0]	= arg0;
+	reply->data.sysex_out.data[1]	= arg1;
+	reply->data.sysex_out.data[2]	= (val >> 14) & 0x7F;
+	reply->data.sysex_out.data[3]	= (val >> 7) & 0x7F;
+	reply->data.sysex_out.data[4]	= val & 0x7F;
+
+	return event_commit(EVENT_CHANNEL_MIDI_OUT);
+}
+
+static int reply_status(u8 cmd, u8 param_enum, u8 status) {
+	midi_event_s* reply =
+			event_reserve_size(EVENT_CHANNEL_MIDI_OUT, MIDI_SYSEX_OUT_EVENT_SIZE(1));
+	if (reply == NULL) {
+		return ERR_NO_MEM;
+	}
+
+	reply->type										= MIDI_EVENT_SYSEX;
+	reply->data.sysex_out.cmd			= cmd;
+	reply->data.sysex_out.param		= param_enum;
+	reply->data.sysex_out.data_len = 1;
+	reply->data.sysex_out.data[0]	= status;
+
+	return event_commit(EVENT_CHANNEL_MIDI_OUT);
+}
@@ -7,6 +7,7 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 
 #include "sys/time.h"
 #include "sys/print.h"
@@ -15,6 +16,7 @@
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 #define DIV_ROUND(a, b) (((a) + (b) / 2) / (b))
+#define TICKS_PER_US		(F_CPU / 1000000UL)
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -44,7 +46,32 @@ void systime_start(void) {
 }
 
 u32 systime_ms(void) {
-	return thetime;
+	u32 ms;
+
+	// thetime is four bytes wide, the overflow ISR may fire between the loads
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		ms = thetime;
+	}
+
+	return ms;
+}
+
+u32 systime_us(void) {
+	u32 ms;
+	u16 ticks;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		ms		= thetime;
+		ticks = TCE0.CNT;
+
+		// The counter has wrapped but the overflow has not been serviced yet
+		if (TCE0.INTFLAGS & TC0_OVFIF_bm) {
+			ms++;
+			ticks = TCE0.CNT;
+		}
+	}
+
+	return (ms * 1000) + (ticks / TICKS_PER_US);
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -0,0 +1,162 @@
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/*                  Copyright (c) (2021 - 2024) Nicolaus Starke               */
+/*                  https://github.com/nic-starke/neon_samurai                */
+/*                         SPDX-License-Identifier: MIT                       */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Documentation ~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+ * Reverse index from a MIDI (channel, CC) to the virtual mappings that use
+ * it, for incoming feedback. Every vmap has one entry, sorted by key, so the
+ * matches for a CC are found with a binary search. Vmaps that are not
+ * configured for a MIDI CC mode have the key KEY_NONE and sort to the end.
+ *
+ * A 16 x 128 lookup table would be O(1) as well, but costs 2KB of RAM against
+ * MF_NUM_VMAPS * 3 bytes for the sorted array.
+ */
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#include "sys/types.h"
+#include "sys/utility.h"
+#include "protocol/midi/midi.h"
+
+#include "platform/midifighter/midifighter.h"
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Defines ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+#define MF_NUM_VMAPS (MF_NUM_ENC_BANKS * MF_NUM_ENCODERS * MF_NUM_VMAPS_PER_ENC)
+#define KEY_NONE		 (0xFFFF)
+
+STATIC_ASSERT(MF_NUM_VMAPS <= UINT8_MAX, "vmap ids are stored in a u8");
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Extern ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Types ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+typedef struct {
+	u16 key; // (channel << 7) | cc, or KEY_NONE
+	u8	id;	 // (bank * MF_NUM_ENCODERS + encoder) * MF_NUM_VMAPS_PER_ENC + vmap
+} index_entry_s;
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Prototypes ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static mf_encoder_s* encoder_of(u8 id);
+static u16					 key_of(u8 id);
+static void					 sift(u8 pos);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Variables ~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Variables ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static index_entry_s entries[MF_NUM_VMAPS];
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Global Functions ~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void mf_vmap_index_init(void) {
+	// Insertion sort, entries before i are already sorted
+	for (u8 i = 0; i < MF_NUM_VMAPS; i++) {
+		const index_entry_s e = {.key = key_of(i), .id = i};
+
+		u8 pos = i;
+		while (pos > 0 && entries[pos - 1].key > e.key) {
+			entries[pos] = entries[pos - 1];
+			pos--;
+		}
+
+		entries[pos] = e;
+	}
+}
+
+void mf_vmap_index_update(u8 bank, u8 enc, u8 vmap) {
+	assert(bank < MF_NUM_ENC_BANKS);
+	assert(enc < MF_NUM_ENCODERS);
+	assert(vmap < MF_NUM_VMAPS_PER_ENC);
+
+	const u8 id = (u8)((bank * MF_NUM_ENCODERS + enc) * MF_NUM_VMAPS_PER_ENC +
+										 vmap);
+
+	for (u8 i = 0; i < MF_NUM_VMAPS; i++) {
+		if (entries[i].id == id) {
+			entries[i].key = key_of(id);
+			sift(i);
+			return;
+		}
+	}
+}
+
+u8 mf_vmap_index_find(u8 channel, u8 cc, u8* first) {
+	assert(first);
+
+	const u16 key = (u16)((channel << 7) | (cc & MIDI_CC_MAX));
+
+	// Lower bound of the key
+	u8 lo = 0;
+	u8 hi = MF_NUM_VMAPS;
+	while (lo < hi) {
+		u8 mid = (u8)((lo + hi) / 2);
+		if (entries[mid].key < key) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	*first = lo;
+
+	u8 count = 0;
+	while (lo + count < MF_NUM_VMAPS && entries[lo + count].key == key) {
+		count++;
+	}
+
+	return count;
+}
+
+mf_encoder_s* mf_vmap_index_get(u8 pos, u8* vmap) {
+	assert(pos < MF_NUM_VMAPS);
+	assert(vmap);
+
+	*vmap = entries[pos].id % MF_NUM_VMAPS_PER_ENC;
+	return encoder_of(entries[pos].id);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Local Functions ~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static mf_encoder_s* encoder_of(u8 id) {
+	const u8 slot = id / MF_NUM_VMAPS_PER_ENC;
+	return &gENCODERS[slot / MF_NUM_ENCODERS][slot % MF_NUM_ENCODERS];
+}
+
+static u16 key_of(u8 id) {
+	const virtmap_s* vmap = &encoder_of(id)->vmaps[id % MF_NUM_VMAPS_PER_ENC];
+
+	if (vmap->cfg.type != PROTOCOL_MIDI) {
+		return KEY_NONE;
+	}
+
+	// Only the CC modes follow CC feedback
+	switch (vmap->cfg.midi.mode) {
+		case MIDI_MODE_DISABLED:
+		case MIDI_MODE_NOTE:
+		case MIDI_MODE_NOTE_PITCH: return KEY_NONE;
+		default: break;
+	}
+
+	return (u16)((vmap->cfg.midi.channel << 7) |
+							 (vmap->cfg.midi.cc & MIDI_CC_MAX));
+}
+
+// Move the entry at pos left or right until the array is sorted again
+static void sift(u8 pos) {
+	const index_entry_s e = entries[pos];
+
+	while (pos > 0 && entries[pos - 1].key > e.key) {
+		entries[pos] = entries[pos - 1];
+		pos--;
+	}
+
+	while (pos + 1 < MF_NUM_VMAPS && entries[pos + 1].key < e.key) {
+		entries[pos] = entries[pos + 1];
+		pos++;
+	}
+
+	entries[pos] = e;
+}